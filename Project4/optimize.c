@@ -4,43 +4,17 @@
 #include <string.h>
 #include <time.h>
 
-#define SM3_DIGEST_SIZE 32
-#define SM3_BLOCK_SIZE 64
+#include "sm3.h"
 
-// IV
-static const uint32_t SM3_IV[8] = {
-    0x7380166fU, 0x4914b2b9U, 0x172442d7U, 0xda8a0600U,
-    0xa96f30bcU, 0x163138aaU, 0xe38dee4dU, 0xb0fb0e4eU
-};
+// gcc -O2 optimize.c -o optimize
 
-#define ROTL32(x,n) ( ( (x) << (n) ) | ( (x) >> (32 - (n)) ) )
 #define SM3_T1 0x79cc4519U
 #define SM3_T2 0x7a879d8aU
 static inline uint32_t T_rot(int j) { return ROTL32((j < 16) ? SM3_T1 : SM3_T2, j & 31); }
 
-#define P0(x) ((x) ^ ROTL32((x),9) ^ ROTL32((x),17))
-#define P1(x) ((x) ^ ROTL32((x),15) ^ ROTL32((x),23))
 #define FF(j,x,y,z) (((j) < 16) ? ((x) ^ (y) ^ (z)) : (((x) & (y)) | ((x) & (z)) | ((y) & (z))))
 #define GG(j,x,y,z) (((j) < 16) ? ((x) ^ (y) ^ (z)) : (((x) & (y)) | ((~(x)) & (z))))
 
-// endian helpers (explicit)
-static inline uint32_t be32_to_cpu(const uint8_t *p) {
-    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | ((uint32_t)p[3]);
-}
-static inline void cpu_to_be32(uint32_t v, uint8_t *p) {
-    p[0] = (uint8_t)((v >> 24) & 0xFF);
-    p[1] = (uint8_t)((v >> 16) & 0xFF);
-    p[2] = (uint8_t)((v >> 8) & 0xFF);
-    p[3] = (uint8_t)(v & 0xFF);
-}
-
-typedef struct {
-    uint64_t total_len; // bytes
-    uint32_t state[8];
-    uint8_t buffer[SM3_BLOCK_SIZE];
-    size_t buffer_len;
-} SM3_CTX;
-
 // ------------------ Corrected compress (opt1) ------------------
 void sm3_compress_opt1(uint32_t state[8], const uint8_t block[SM3_BLOCK_SIZE]) {
     uint32_t W[68], Wp[64];
@@ -77,21 +51,147 @@ void sm3_compress_opt1(uint32_t state[8], const uint8_t block[SM3_BLOCK_SIZE]) {
     state[4] ^= E; state[5] ^= F; state[6] ^= G; state[7] ^= H;
 }
 
-// ------------------ Corrected compress (opt2) ------------------
-// For correctness-first, compute full W/Wp as well (safe). Later we can implement a true,
-// correct on-the-fly expansion, but it's tricky and must be carefully tested.
+// ------------------ Unrolled compress (opt2) ------------------
+// The shared core in sm3.h: fully unrolled rounds with on-the-fly message
+// expansion (16-word sliding W window, W' formed inside each round,
+// precomputed T_j <<< j, rounds 0-15 split from 16-63).
 void sm3_compress_opt2(uint32_t state[8], const uint8_t block[SM3_BLOCK_SIZE]) {
-    // identical to opt1 for correctness baseline
-    sm3_compress_opt1(state, block);
+    sm3_compress(state, block);
 }
 
-// ------------------ High level functions ------------------
-void sm3_init(SM3_CTX *ctx) {
-    ctx->total_len = 0;
-    ctx->buffer_len = 0;
-    memcpy(ctx->state, SM3_IV, sizeof(SM3_IV));
+// ------------------ SIMD message expansion (opt3) ------------------
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SM3_HAVE_SIMD 1
+
+#define MM_ROTL32(x,n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+// W[j..j+2] in one 4-lane step. They only depend on W[j-3] and older; lane 3
+// reads the not-yet-computed W[j] and is rewritten by the next step, so W
+// needs room for 71 words.
+#define EXPAND3(W,j) do { \
+    __m128i w16 = _mm_loadu_si128((const __m128i *)((W) + (j) - 16)); \
+    __m128i w9  = _mm_loadu_si128((const __m128i *)((W) + (j) - 9)); \
+    __m128i w3  = _mm_loadu_si128((const __m128i *)((W) + (j) - 3)); \
+    __m128i w13 = _mm_loadu_si128((const __m128i *)((W) + (j) - 13)); \
+    __m128i w6  = _mm_loadu_si128((const __m128i *)((W) + (j) - 6)); \
+    __m128i t = _mm_xor_si128(_mm_xor_si128(w16, w9), MM_ROTL32(w3, 15)); \
+    t = _mm_xor_si128(_mm_xor_si128(t, MM_ROTL32(t, 15)), MM_ROTL32(t, 23)); \
+    t = _mm_xor_si128(_mm_xor_si128(t, MM_ROTL32(w13, 7)), w6); \
+    _mm_storeu_si128((__m128i *)((W) + (j)), t); \
+} while (0)
+
+// W'[j..j+3] = W[j..j+3] ^ W[j+4..j+7], then four renamed rounds.
+#define GROUP4(FFx,GGx,j) do { \
+    _mm_storeu_si128((__m128i *)Wp, _mm_xor_si128( \
+        _mm_loadu_si128((const __m128i *)(W + (j))), \
+        _mm_loadu_si128((const __m128i *)(W + (j) + 4)))); \
+    SM3_ROUND(A,B,C,D,E,F,G,H,FFx,GGx,(j)+0,W[(j)+0],Wp[0]); \
+    SM3_ROUND(D,A,B,C,H,E,F,G,FFx,GGx,(j)+1,W[(j)+1],Wp[1]); \
+    SM3_ROUND(C,D,A,B,G,H,E,F,FFx,GGx,(j)+2,W[(j)+2],Wp[2]); \
+    SM3_ROUND(B,C,D,A,F,G,H,E,FFx,GGx,(j)+3,W[(j)+3],Wp[3]); \
+} while (0)
+
+// Expansion steps are interleaved with the rounds, staying a few words ahead
+// of the W[j+4] each group needs, so the vector unit works while the scalar
+// round chain is busy instead of in a separate pass up front.
+#define SM3_SIMD_BODY() do { \
+    const __m128i bswap = _mm_setr_epi8(3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12); \
+    for (int j = 0; j < 16; j += 4) { \
+        __m128i m = _mm_loadu_si128((const __m128i *)(block + j*4)); \
+        _mm_storeu_si128((__m128i *)(W + j), _mm_shuffle_epi8(m, bswap)); \
+    } \
+    uint32_t A = S0, B = S1, C = S2, D = S3; \
+    uint32_t E = S4, F = S5, G = S6, H = S7; \
+    GROUP4(SM3_FF0,SM3_GG0,0);  GROUP4(SM3_FF0,SM3_GG0,4);  EXPAND3(W,16); EXPAND3(W,19); \
+    GROUP4(SM3_FF0,SM3_GG0,8);  EXPAND3(W,22); \
+    GROUP4(SM3_FF0,SM3_GG0,12); EXPAND3(W,25); \
+    GROUP4(SM3_FF1,SM3_GG1,16); EXPAND3(W,28); EXPAND3(W,31); \
+    GROUP4(SM3_FF1,SM3_GG1,20); EXPAND3(W,34); \
+    GROUP4(SM3_FF1,SM3_GG1,24); EXPAND3(W,37); \
+    GROUP4(SM3_FF1,SM3_GG1,28); EXPAND3(W,40); EXPAND3(W,43); \
+    GROUP4(SM3_FF1,SM3_GG1,32); EXPAND3(W,46); \
+    GROUP4(SM3_FF1,SM3_GG1,36); EXPAND3(W,49); \
+    GROUP4(SM3_FF1,SM3_GG1,40); EXPAND3(W,52); EXPAND3(W,55); \
+    GROUP4(SM3_FF1,SM3_GG1,44); EXPAND3(W,58); \
+    GROUP4(SM3_FF1,SM3_GG1,48); EXPAND3(W,61); \
+    GROUP4(SM3_FF1,SM3_GG1,52); EXPAND3(W,64); EXPAND3(W,67); \
+    GROUP4(SM3_FF1,SM3_GG1,56); \
+    GROUP4(SM3_FF1,SM3_GG1,60); \
+    S0 ^= A; S1 ^= B; S2 ^= C; S3 ^= D; \
+    S4 ^= E; S5 ^= F; S6 ^= G; S7 ^= H; \
+} while (0)
+
+// Multi-block driver: the chaining value S0..S7 stays in registers across
+// blocks and touches state[] only on entry and exit.
+#define SM3_SIMD_BLOCKS() do { \
+    uint32_t W[72], Wp[4]; \
+    uint32_t S0 = state[0], S1 = state[1], S2 = state[2], S3 = state[3]; \
+    uint32_t S4 = state[4], S5 = state[5], S6 = state[6], S7 = state[7]; \
+    for (; nblocks > 0; --nblocks, block += SM3_BLOCK_SIZE) SM3_SIMD_BODY(); \
+    state[0] = S0; state[1] = S1; state[2] = S2; state[3] = S3; \
+    state[4] = S4; state[5] = S5; state[6] = S6; state[7] = S7; \
+} while (0)
+
+__attribute__((target("ssse3")))
+void sm3_compress_blocks_sse(uint32_t state[8], const uint8_t *block, size_t nblocks) {
+    SM3_SIMD_BLOCKS();
+}
+
+void sm3_compress_sse(uint32_t state[8], const uint8_t block[SM3_BLOCK_SIZE]) {
+    sm3_compress_blocks_sse(state, block, 1);
+}
+#endif
+
+typedef void (*sm3_compress_fn)(uint32_t*, const uint8_t*);
+
+static int sm3_cpu_has_ssse3(void) {
+#ifdef SM3_HAVE_SIMD
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#else
+    return 0;
+#endif
 }
 
+// The scalar core unless the caller opts in with use_simd and the CPU has
+// SSSE3; call once and pass the result to sm3_update_with / sm3_hash_with.
+// The SIMD backend is not the default: W[j] depends on W[j-3], so a vector
+// step yields at most 3 words, the expansion is a small share of the work,
+// and on the benchmark below it does not beat opt2 by more than the spread
+// between runs.
+sm3_compress_fn sm3_select_compress(int use_simd) {
+#ifdef SM3_HAVE_SIMD
+    if (use_simd && sm3_cpu_has_ssse3()) return sm3_compress_sse;
+#endif
+    return sm3_compress_opt2;
+}
+
+// ------------------ Compile-time specialised update ------------------
+// SM3_DEFINE_UPDATE (sm3.h) stamps out <prefix>_update/_final/_hash with the
+// blocks backend fixed at compile time; all full blocks of one update go to
+// the backend in a single call. sm3_update/sm3_hash in sm3.h are the
+// instantiation for the scalar core.
+static void sm3_compress_blocks_opt1(uint32_t state[8], const uint8_t *data, size_t nblocks) {
+    for (; nblocks > 0; --nblocks, data += SM3_BLOCK_SIZE) sm3_compress_opt1(state, data);
+}
+
+SM3_DEFINE_UPDATE(sm3_opt1, sm3_compress_blocks_opt1)
+#ifdef SM3_HAVE_SIMD
+SM3_DEFINE_UPDATE(sm3_sse, sm3_compress_blocks_sse)
+#endif
+
+typedef void (*sm3_hash_fn)(const uint8_t*, size_t, uint8_t*);
+
+// Same opt-in rule as sm3_select_compress; select once, never per block.
+sm3_hash_fn sm3_select_hash(int use_simd) {
+#ifdef SM3_HAVE_SIMD
+    if (use_simd && sm3_cpu_has_ssse3()) return sm3_sse_hash;
+#endif
+    return sm3_hash;
+}
+
+// ------------------ High level functions ------------------
 void sm3_update_with(SM3_CTX *ctx, const uint8_t *data, size_t len,
                      void (*compress)(uint32_t*, const uint8_t*)) {
     size_t left = ctx->buffer_len;
@@ -179,23 +279,62 @@ void test_and_benchmark() {
     printf("opt1 ok: %s\n", (memcmp(out1, expected, SM3_DIGEST_SIZE)==0) ? "YES" : "NO");
     printf("opt2 ok: %s\n", (memcmp(out2, expected, SM3_DIGEST_SIZE)==0) ? "YES" : "NO");
 
-    // benchmark (1MB)
-    const size_t test_size = 1024 * 1024;
+    // benchmark (16MB, best of 5 interleaved trials)
+    const size_t test_size = 16 * 1024 * 1024;
     uint8_t *data = malloc(test_size);
     for (size_t i = 0; i < test_size; ++i) data[i] = (uint8_t)(i & 0xFF);
 
-    const int rounds = 8;
-    clock_t t0 = clock();
-    for (int i = 0; i < rounds; ++i) sm3_hash_with(data, test_size, out, sm3_compress_opt1);
-    clock_t t1 = clock();
-    double sec1 = (double)(t1 - t0) / CLOCKS_PER_SEC / (double)rounds;
-    printf("opt1: %.3f sec per 1MB, %.2f MB/s\n", sec1, 1.0 / sec1);
-
-    t0 = clock();
-    for (int i = 0; i < rounds; ++i) sm3_hash_with(data, test_size, out, sm3_compress_opt2);
-    t1 = clock();
-    double sec2 = (double)(t1 - t0) / CLOCKS_PER_SEC / (double)rounds;
-    printf("opt2: %.3f sec per 1MB, %.2f MB/s\n", sec2, 1.0 / sec2);
+    sm3_hash_with(data, test_size, out1, sm3_compress_opt1);
+    sm3_hash_with(data, test_size, out2, sm3_compress_opt2);
+    printf("opt1 == opt2 on 16MB: %s\n", (memcmp(out1, out2, SM3_DIGEST_SIZE)==0) ? "YES" : "NO");
+    sm3_compress_fn simd = sm3_select_compress(1);
+    sm3_hash_with(data, test_size, out2, simd);
+    printf("opt1 == simd on 16MB: %s\n", (memcmp(out1, out2, SM3_DIGEST_SIZE)==0) ? "YES" : "NO");
+
+    sm3_compress_fn backends[3] = { sm3_compress_opt1, sm3_compress_opt2, simd };
+    const char *names[3] = { "opt1", "opt2", "simd" };
+    double best[3] = { 0, 0, 0 };
+    for (int trial = 0; trial < 5; ++trial) {
+        for (int v = 0; v < 3; ++v) {
+            clock_t t0 = clock();
+            sm3_hash_with(data, test_size, out, backends[v]);
+            double mb = (double)test_size / (1024.0 * 1024.0) / ((double)(clock() - t0) / CLOCKS_PER_SEC);
+            if (mb > best[v]) best[v] = mb;
+        }
+    }
+    for (int v = 0; v < 3; ++v) printf("%s: %.2f MB/s\n", names[v], best[v]);
+
+    // per-block function pointer vs compile-time specialised multi-block update
+    printf("\nper-block pointer vs specialised update (MB/s):\n");
+    printf("%8s %10s %10s %10s %10s\n", "size", "opt2 ptr", "sm3_hash", "simd ptr", "simd hash");
+    sm3_hash_fn simd_hash = sm3_select_hash(1);
+    const size_t sizes[] = { 1024, 16 * 1024, 64 * 1024, 1024 * 1024 };
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+        size_t len = sizes[k];
+        size_t reps = (16u << 20) / len;
+        double mbs[4] = { 0, 0, 0, 0 };
+        // best of 5 interleaved trials, so drift in clock speed hits all four alike
+        for (int trial = 0; trial < 5; ++trial) {
+            for (int v = 0; v < 4; ++v) {
+                clock_t b0 = clock();
+                for (size_t r = 0; r < reps; ++r) {
+                    switch (v) {
+                    case 0: sm3_hash_with(data, len, out, sm3_compress_opt2); break;
+                    case 1: sm3_hash(data, len, out); break;
+                    case 2: sm3_hash_with(data, len, out, simd); break;
+                    default: simd_hash(data, len, out); break;
+                    }
+                }
+                double sec = (double)(clock() - b0) / CLOCKS_PER_SEC;
+                double mb = (double)(reps * len) / (1024.0 * 1024.0) / sec;
+                if (mb > mbs[v]) mbs[v] = mb;
+            }
+        }
+        printf("%7zuK %10.2f %10.2f %10.2f %10.2f\n", len / 1024, mbs[0], mbs[1], mbs[2], mbs[3]);
+    }
+    simd_hash(data, test_size, out1);
+    sm3_hash(data, test_size, out2);
+    printf("simd hash == sm3_hash on 16MB: %s\n", (memcmp(out1, out2, SM3_DIGEST_SIZE)==0) ? "YES" : "NO");
 
     free(data);
 }
@@ -0,0 +1,286 @@
+#ifndef SM3_H
+#define SM3_H
+
+// SM3公共核心：basic.c / optimize.c / attack.c / Merkle.c / sm3_mb.c 共用。
+// 全部为static inline，各程序仍可单文件编译：gcc -O2 xxx.c -o xxx
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SM3_DIGEST_SIZE 32
+#define SM3_BLOCK_SIZE 64
+
+static const uint32_t SM3_IV[8] = {
+    0x7380166fU, 0x4914b2b9U, 0x172442d7U, 0xda8a0600U,
+    0xa96f30bcU, 0x163138aaU, 0xe38dee4dU, 0xb0fb0e4eU
+};
+
+// T_j <<< (j mod 32)，预先计算，轮函数中无需再移位
+static const uint32_t SM3_TJ_ROT[64] = {
+    0x79cc4519U, 0xf3988a32U, 0xe7311465U, 0xce6228cbU,
+    0x9cc45197U, 0x3988a32fU, 0x7311465eU, 0xe6228cbcU,
+    0xcc451979U, 0x988a32f3U, 0x311465e7U, 0x6228cbceU,
+    0xc451979cU, 0x88a32f39U, 0x11465e73U, 0x228cbce6U,
+    0x9d8a7a87U, 0x3b14f50fU, 0x7629ea1eU, 0xec53d43cU,
+    0xd8a7a879U, 0xb14f50f3U, 0x629ea1e7U, 0xc53d43ceU,
+    0x8a7a879dU, 0x14f50f3bU, 0x29ea1e76U, 0x53d43cecU,
+    0xa7a879d8U, 0x4f50f3b1U, 0x9ea1e762U, 0x3d43cec5U,
+    0x7a879d8aU, 0xf50f3b14U, 0xea1e7629U, 0xd43cec53U,
+    0xa879d8a7U, 0x50f3b14fU, 0xa1e7629eU, 0x43cec53dU,
+    0x879d8a7aU, 0x0f3b14f5U, 0x1e7629eaU, 0x3cec53d4U,
+    0x79d8a7a8U, 0xf3b14f50U, 0xe7629ea1U, 0xcec53d43U,
+    0x9d8a7a87U, 0x3b14f50fU, 0x7629ea1eU, 0xec53d43cU,
+    0xd8a7a879U, 0xb14f50f3U, 0x629ea1e7U, 0xc53d43ceU,
+    0x8a7a879dU, 0x14f50f3bU, 0x29ea1e76U, 0x53d43cecU,
+    0xa7a879d8U, 0x4f50f3b1U, 0x9ea1e762U, 0x3d43cec5U,
+};
+
+#define ROTL32(x,n) ( ( (x) << (n) ) | ( (x) >> (32 - (n)) ) )
+#define P0(x) ((x) ^ ROTL32((x),9) ^ ROTL32((x),17))
+#define P1(x) ((x) ^ ROTL32((x),15) ^ ROTL32((x),23))
+
+// 0-15轮与16-63轮分开，避免轮内对j判断
+#define SM3_FF0(x,y,z) ((x) ^ (y) ^ (z))
+#define SM3_FF1(x,y,z) (((x) & (y)) | (((x) | (y)) & (z)))
+#define SM3_GG0(x,y,z) ((x) ^ (y) ^ (z))
+#define SM3_GG1(x,y,z) ((z) ^ ((x) & ((y) ^ (z))))
+
+static inline uint32_t be32_to_cpu(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | ((uint32_t)p[3]);
+}
+static inline void cpu_to_be32(uint32_t v, uint8_t *p) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+typedef struct {
+    uint64_t total_len;    // 总字节数
+    uint32_t state[8];
+    uint8_t buffer[SM3_BLOCK_SIZE];   // 不足一个分组的尾部
+    size_t buffer_len;
+} SM3_CTX;
+
+// 由16字滑动窗口计算W[j+4]，覆盖槽(j+4)&15（原为W[j-12]）
+#define SM3_EXPAND(W,j) \
+    (W[((j)+4) & 15] = P1(W[((j)+4) & 15] ^ W[((j)+11) & 15] ^ ROTL32(W[((j)+1) & 15], 15)) \
+                       ^ ROTL32(W[((j)+7) & 15], 7) ^ W[((j)+14) & 15])
+
+// 单轮，不做A..H的整体移动：调用方在相邻轮之间轮换参数角色，只写B、D、F、H
+#define SM3_ROUND(A,B,C,D,E,F,G,H,FFx,GGx,j,Wj,Wpj) do { \
+    uint32_t A12 = ROTL32(A, 12); \
+    uint32_t SS1 = ROTL32(A12 + E + SM3_TJ_ROT[j], 7); \
+    uint32_t SS2 = SS1 ^ A12; \
+    uint32_t TT1 = FFx(A, B, C) + D + SS2 + (Wpj); \
+    uint32_t TT2 = GGx(E, F, G) + H + SS1 + (Wj); \
+    B = ROTL32(B, 9); \
+    F = ROTL32(F, 19); \
+    D = TT1; \
+    H = P0(TT2); \
+} while (0)
+
+#define SM3_ROUND4_0_15(j) do { \
+    SM3_ROUND(A,B,C,D,E,F,G,H,SM3_FF0,SM3_GG0,(j)+0,W[((j)+0)&15],W[((j)+0)&15]^W[((j)+4)&15]); \
+    SM3_ROUND(D,A,B,C,H,E,F,G,SM3_FF0,SM3_GG0,(j)+1,W[((j)+1)&15],W[((j)+1)&15]^W[((j)+5)&15]); \
+    SM3_ROUND(C,D,A,B,G,H,E,F,SM3_FF0,SM3_GG0,(j)+2,W[((j)+2)&15],W[((j)+2)&15]^W[((j)+6)&15]); \
+    SM3_ROUND(B,C,D,A,F,G,H,E,SM3_FF0,SM3_GG0,(j)+3,W[((j)+3)&15],W[((j)+3)&15]^W[((j)+7)&15]); \
+} while (0)
+
+#define SM3_ROUND4_16_63(j) do { \
+    SM3_EXPAND(W,(j)+0); SM3_ROUND(A,B,C,D,E,F,G,H,SM3_FF1,SM3_GG1,(j)+0,W[((j)+0)&15],W[((j)+0)&15]^W[((j)+4)&15]); \
+    SM3_EXPAND(W,(j)+1); SM3_ROUND(D,A,B,C,H,E,F,G,SM3_FF1,SM3_GG1,(j)+1,W[((j)+1)&15],W[((j)+1)&15]^W[((j)+5)&15]); \
+    SM3_EXPAND(W,(j)+2); SM3_ROUND(C,D,A,B,G,H,E,F,SM3_FF1,SM3_GG1,(j)+2,W[((j)+2)&15],W[((j)+2)&15]^W[((j)+6)&15]); \
+    SM3_EXPAND(W,(j)+3); SM3_ROUND(B,C,D,A,F,G,H,E,SM3_FF1,SM3_GG1,(j)+3,W[((j)+3)&15],W[((j)+3)&15]^W[((j)+7)&15]); \
+} while (0)
+
+// 多分组压缩：A..H与链接值S0..S7在整段数据上都保持在局部变量（寄存器）中，
+// 只在开始和结束时读写state。64轮完全展开，消息扩展只保留16字窗口，W'在轮内计算
+static inline void sm3_compress_blocks(uint32_t state[8], const uint8_t *data, size_t nblocks) {
+    uint32_t S0 = state[0], S1 = state[1], S2 = state[2], S3 = state[3];
+    uint32_t S4 = state[4], S5 = state[5], S6 = state[6], S7 = state[7];
+
+    for (; nblocks > 0; --nblocks, data += SM3_BLOCK_SIZE) {
+        uint32_t W[16];
+        for (int j = 0; j < 16; ++j) W[j] = be32_to_cpu(data + j*4);
+
+        uint32_t A = S0, B = S1, C = S2, D = S3;
+        uint32_t E = S4, F = S5, G = S6, H = S7;
+
+        // 0-11轮只用到W[0..15]；从第12轮起，W[j+4]在使用前计算
+        SM3_ROUND4_0_15(0);
+        SM3_ROUND4_0_15(4);
+        SM3_ROUND4_0_15(8);
+        SM3_EXPAND(W,12); SM3_ROUND(A,B,C,D,E,F,G,H,SM3_FF0,SM3_GG0,12,W[12],W[12]^W[0]);
+        SM3_EXPAND(W,13); SM3_ROUND(D,A,B,C,H,E,F,G,SM3_FF0,SM3_GG0,13,W[13],W[13]^W[1]);
+        SM3_EXPAND(W,14); SM3_ROUND(C,D,A,B,G,H,E,F,SM3_FF0,SM3_GG0,14,W[14],W[14]^W[2]);
+        SM3_EXPAND(W,15); SM3_ROUND(B,C,D,A,F,G,H,E,SM3_FF0,SM3_GG0,15,W[15],W[15]^W[3]);
+
+        SM3_ROUND4_16_63(16); SM3_ROUND4_16_63(20); SM3_ROUND4_16_63(24); SM3_ROUND4_16_63(28);
+        SM3_ROUND4_16_63(32); SM3_ROUND4_16_63(36); SM3_ROUND4_16_63(40); SM3_ROUND4_16_63(44);
+        SM3_ROUND4_16_63(48); SM3_ROUND4_16_63(52); SM3_ROUND4_16_63(56); SM3_ROUND4_16_63(60);
+
+        S0 ^= A; S1 ^= B; S2 ^= C; S3 ^= D;
+        S4 ^= E; S5 ^= F; S6 ^= G; S7 ^= H;
+    }
+
+    state[0] = S0; state[1] = S1; state[2] = S2; state[3] = S3;
+    state[4] = S4; state[5] = S5; state[6] = S6; state[7] = S7;
+}
+
+// 单分组压缩
+static inline void sm3_compress(uint32_t state[8], const uint8_t block[SM3_BLOCK_SIZE]) {
+    sm3_compress_blocks(state, block, 1);
+}
+
+static inline void sm3_init(SM3_CTX *ctx) {
+    ctx->total_len = 0;
+    ctx->buffer_len = 0;
+    memcpy(ctx->state, SM3_IV, sizeof(SM3_IV));
+}
+
+// 按压缩后端生成 prefix_update / prefix_final / prefix_hash。
+// 后端 blocks_fn(state, data, nblocks) 在编译期确定，可被内联；
+// update 把所有完整分组一次交给 blocks_fn，而不是逐分组间接调用。
+// 完整分组直接从调用者缓冲区压缩，只有不足64字节的尾部拷入ctx->buffer；
+// 填充直接写在ctx->buffer中：0x80、补0、64bit大端比特长度。
+#define SM3_DEFINE_UPDATE(prefix, blocks_fn) \
+static inline void prefix##_update(SM3_CTX *ctx, const uint8_t *data, size_t len) { \
+    if (len == 0) return; \
+    ctx->total_len += len; \
+    if (ctx->buffer_len) { \
+        size_t fill = SM3_BLOCK_SIZE - ctx->buffer_len; \
+        if (fill > len) fill = len; \
+        memcpy(ctx->buffer + ctx->buffer_len, data, fill); \
+        ctx->buffer_len += fill; \
+        data += fill; len -= fill; \
+        if (ctx->buffer_len < SM3_BLOCK_SIZE) return; \
+        blocks_fn(ctx->state, ctx->buffer, 1); \
+        ctx->buffer_len = 0; \
+    } \
+    if (len >= SM3_BLOCK_SIZE) { \
+        size_t nblocks = len / SM3_BLOCK_SIZE; \
+        blocks_fn(ctx->state, data, nblocks); \
+        data += nblocks * SM3_BLOCK_SIZE; len -= nblocks * SM3_BLOCK_SIZE; \
+    } \
+    if (len > 0) { \
+        memcpy(ctx->buffer, data, len); \
+        ctx->buffer_len = len; \
+    } \
+} \
+static inline void prefix##_final(SM3_CTX *ctx, uint8_t digest[SM3_DIGEST_SIZE]) { \
+    uint64_t total_bits = ctx->total_len * 8; \
+    size_t idx = ctx->buffer_len; \
+    ctx->buffer[idx++] = 0x80; \
+    if (idx > SM3_BLOCK_SIZE - 8) { \
+        memset(ctx->buffer + idx, 0, SM3_BLOCK_SIZE - idx); \
+        blocks_fn(ctx->state, ctx->buffer, 1); \
+        idx = 0; \
+    } \
+    memset(ctx->buffer + idx, 0, SM3_BLOCK_SIZE - 8 - idx); \
+    for (int i = 0; i < 8; i++) { \
+        ctx->buffer[SM3_BLOCK_SIZE - 8 + i] = (uint8_t)(total_bits >> (56 - 8*i)); \
+    } \
+    blocks_fn(ctx->state, ctx->buffer, 1); \
+    for (int i = 0; i < 8; i++) { \
+        cpu_to_be32(ctx->state[i], digest + i*4); \
+    } \
+} \
+static inline void prefix##_hash(const uint8_t *data, size_t len, uint8_t digest[SM3_DIGEST_SIZE]) { \
+    SM3_CTX ctx; \
+    sm3_init(&ctx); \
+    prefix##_update(&ctx, data, len); \
+    prefix##_final(&ctx, digest); \
+}
+
+// sm3_update / sm3_final / sm3_hash：使用上面的标量展开压缩函数
+SM3_DEFINE_UPDATE(sm3, sm3_compress_blocks)
+
+// 中间状态导出/导入：可序列化的SM3_CTX快照，导入后继续update/final，
+// 结果与不中断地哈希整条消息相同。格式（共105字节，与字节序无关）：
+//   state[8]（大端，32字节） || total_len（大端，8字节） || buffer_len（1字节） || buffer（64字节）
+#define SM3_MIDSTATE_SIZE (SM3_DIGEST_SIZE + 8 + 1 + SM3_BLOCK_SIZE)
+
+static inline void sm3_export(const SM3_CTX *ctx, uint8_t out[SM3_MIDSTATE_SIZE]) {
+    for (int i = 0; i < 8; i++) cpu_to_be32(ctx->state[i], out + i*4);
+    for (int i = 0; i < 8; i++) out[SM3_DIGEST_SIZE + i] = (uint8_t)(ctx->total_len >> (56 - 8*i));
+    out[SM3_DIGEST_SIZE + 8] = (uint8_t)ctx->buffer_len;
+    memset(out + SM3_DIGEST_SIZE + 9, 0, SM3_BLOCK_SIZE);
+    memcpy(out + SM3_DIGEST_SIZE + 9, ctx->buffer, ctx->buffer_len);
+}
+
+// 返回0；快照不一致（buffer_len与total_len不符）时返回-1，ctx不变
+static inline int sm3_import(SM3_CTX *ctx, const uint8_t in[SM3_MIDSTATE_SIZE]) {
+    uint64_t total_len = 0;
+    for (int i = 0; i < 8; i++) total_len = (total_len << 8) | in[SM3_DIGEST_SIZE + i];
+    size_t buffer_len = in[SM3_DIGEST_SIZE + 8];
+    if (buffer_len >= SM3_BLOCK_SIZE || total_len % SM3_BLOCK_SIZE != buffer_len) return -1;
+    for (int i = 0; i < 8; i++) ctx->state[i] = be32_to_cpu(in + i*4);
+    ctx->total_len = total_len;
+    ctx->buffer_len = buffer_len;
+    memcpy(ctx->buffer, in + SM3_DIGEST_SIZE + 9, buffer_len);
+    return 0;
+}
+
+// 从摘要恢复上下文：digest视为处理完total_len字节（须为64的倍数，即含填充）后的链接值。
+// 长度扩展攻击即由此继续哈希
+static inline void sm3_resume(SM3_CTX *ctx, const uint8_t digest[SM3_DIGEST_SIZE], uint64_t total_len) {
+    for (int i = 0; i < 8; i++) ctx->state[i] = be32_to_cpu(digest + i*4);
+    ctx->total_len = total_len;
+    ctx->buffer_len = 0;
+}
+
+// ---- 65字节消息专用：Merkle内部节点 0x01 || L || R ----
+// 第二个分组为 m[64] || 0x80 || 补0 || 比特长度520：W[1..14]为0，W[15] = 520，只有W[0]的最高字节随消息变化。
+// 消息扩展在GF(2)上是线性的，扩展后的W[0..67]只取决于m[64]，256种取值预先算成表，第二次压缩不做消息扩展
+#define SM3_PAD65_W0(b) (((uint32_t)(b) << 24) | 0x00800000U)
+#define SM3_PAD65_BITS (65 * 8)
+
+static inline void sm3_pad65_table_init(uint32_t table[256][68]) {
+    for (int b = 0; b < 256; b++) {
+        uint32_t *W = table[b];
+        memset(W, 0, sizeof(uint32_t) * 16);
+        W[0] = SM3_PAD65_W0(b);
+        W[15] = SM3_PAD65_BITS;
+        for (int j = 16; j < 68; j++) {
+            W[j] = P1(W[j-16] ^ W[j-9] ^ ROTL32(W[j-3], 15)) ^ ROTL32(W[j-13], 7) ^ W[j-6];
+        }
+    }
+}
+
+#define SM3_ROUND4_EXPANDED(j,FFx,GGx) do { \
+    SM3_ROUND(A,B,C,D,E,F,G,H,FFx,GGx,(j)+0,W[(j)+0],W[(j)+0]^W[(j)+4]); \
+    SM3_ROUND(D,A,B,C,H,E,F,G,FFx,GGx,(j)+1,W[(j)+1],W[(j)+1]^W[(j)+5]); \
+    SM3_ROUND(C,D,A,B,G,H,E,F,FFx,GGx,(j)+2,W[(j)+2],W[(j)+2]^W[(j)+6]); \
+    SM3_ROUND(B,C,D,A,F,G,H,E,FFx,GGx,(j)+3,W[(j)+3],W[(j)+3]^W[(j)+7]); \
+} while (0)
+
+// 用已扩展好的W[0..67]压缩一次
+static inline void sm3_compress_expanded(uint32_t state[8], const uint32_t W[68]) {
+    uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
+    uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
+
+    SM3_ROUND4_EXPANDED(0,SM3_FF0,SM3_GG0);  SM3_ROUND4_EXPANDED(4,SM3_FF0,SM3_GG0);
+    SM3_ROUND4_EXPANDED(8,SM3_FF0,SM3_GG0);  SM3_ROUND4_EXPANDED(12,SM3_FF0,SM3_GG0);
+    SM3_ROUND4_EXPANDED(16,SM3_FF1,SM3_GG1); SM3_ROUND4_EXPANDED(20,SM3_FF1,SM3_GG1);
+    SM3_ROUND4_EXPANDED(24,SM3_FF1,SM3_GG1); SM3_ROUND4_EXPANDED(28,SM3_FF1,SM3_GG1);
+    SM3_ROUND4_EXPANDED(32,SM3_FF1,SM3_GG1); SM3_ROUND4_EXPANDED(36,SM3_FF1,SM3_GG1);
+    SM3_ROUND4_EXPANDED(40,SM3_FF1,SM3_GG1); SM3_ROUND4_EXPANDED(44,SM3_FF1,SM3_GG1);
+    SM3_ROUND4_EXPANDED(48,SM3_FF1,SM3_GG1); SM3_ROUND4_EXPANDED(52,SM3_FF1,SM3_GG1);
+    SM3_ROUND4_EXPANDED(56,SM3_FF1,SM3_GG1); SM3_ROUND4_EXPANDED(60,SM3_FF1,SM3_GG1);
+
+    state[0] ^= A; state[1] ^= B; state[2] ^= C; state[3] ^= D;
+    state[4] ^= E; state[5] ^= F; state[6] ^= G; state[7] ^= H;
+}
+
+// SM3(m[0..65))：压缩第一个分组，第二个分组查table（由sm3_pad65_table_init填好），不经过SM3_CTX与填充逻辑
+static inline void sm3_hash65(const uint8_t m[65], const uint32_t table[256][68], uint8_t digest[SM3_DIGEST_SIZE]) {
+    uint32_t s[8];
+    memcpy(s, SM3_IV, sizeof(s));
+    sm3_compress_blocks(s, m, 1);
+    sm3_compress_expanded(s, table[m[64]]);
+    for (int i = 0; i < 8; i++) cpu_to_be32(s[i], digest + i*4);
+}
+
+#endif
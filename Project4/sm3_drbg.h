@@ -0,0 +1,245 @@
+#ifndef SM3_DRBG_H
+#define SM3_DRBG_H
+
+// Hash_DRBG (NIST SP 800-90A, section 10.1.1) instantiated with SM3.
+//
+// SM3 has a 256-bit output, so seedlen is 440 bits (55 bytes) as for SHA-256.
+// The explicit API (instantiate / reseed / generate) follows the standard
+// step by step. Hashgen hashes V, V+1, V+2, ..., which are independent
+// single-block messages, so generate takes an optional multi-buffer manager
+// and hashes them across the lanes.
+//
+// sm3_drbg_rand_bytes is the cheap front end for nonces and ephemeral keys.
+// Each thread owns a DRBG instance and a SM3_DRBG_POOL-byte output pool in
+// thread-local storage, so requests take no locks. A request copies bytes out
+// of the pool, which is refilled by one large multi-lane generate call when it
+// runs dry. The instance is seeded from getrandom() on first use, after
+// SM3_DRBG_RESEED_INTERVAL generate calls, and in a fork()ed child, whose
+// copy of the pool is discarded by an atfork handler so that parent and
+// child never hand out the same bytes. Link with -lpthread.
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/random.h>
+#include "sm3.h"
+#include "sm3_mb.h"
+
+#define SM3_DRBG_SEEDLEN 55
+#define SM3_DRBG_MAX_REQUEST (1u << 16)          // 2^19 bits per generate call
+#define SM3_DRBG_RESEED_INTERVAL (1u << 20)      // generate calls between reseeds
+#define SM3_DRBG_ENTROPY_LEN 32
+#define SM3_DRBG_POOL (16u * 1024)
+#define SM3_DRBG_BATCH 256
+
+typedef struct {
+    uint8_t V[SM3_DRBG_SEEDLEN];
+    uint8_t C[SM3_DRBG_SEEDLEN];
+    uint64_t reseed_counter;
+} SM3_DRBG;
+
+// V = (V + x) mod 2^440, x big endian of any length <= seedlen
+static inline void sm3_drbg_add(uint8_t V[SM3_DRBG_SEEDLEN], const uint8_t *x, size_t xlen) {
+    unsigned carry = 0;
+    for (size_t i = 0; i < SM3_DRBG_SEEDLEN; ++i) {
+        unsigned s = V[SM3_DRBG_SEEDLEN - 1 - i] + carry + (i < xlen ? x[xlen - 1 - i] : 0);
+        V[SM3_DRBG_SEEDLEN - 1 - i] = (uint8_t)s;
+        carry = s >> 8;
+        if (i >= xlen && carry == 0) break;
+    }
+}
+
+// Hash_df over the concatenation of up to four inputs (NULL/0 to skip).
+static inline void sm3_drbg_hash_df(const uint8_t *in[4], const size_t in_len[4],
+                                    uint8_t out[SM3_DRBG_SEEDLEN]) {
+    uint8_t head[5], d[SM3_DIGEST_SIZE];
+    cpu_to_be32(SM3_DRBG_SEEDLEN * 8, head + 1);
+    for (size_t off = 0, counter = 1; off < SM3_DRBG_SEEDLEN; off += SM3_DIGEST_SIZE, ++counter) {
+        SM3_CTX ctx;
+        head[0] = (uint8_t)counter;
+        sm3_init(&ctx);
+        sm3_update(&ctx, head, sizeof(head));
+        for (int k = 0; k < 4; ++k) if (in[k]) sm3_update(&ctx, in[k], in_len[k]);
+        sm3_final(&ctx, d);
+        size_t n = SM3_DRBG_SEEDLEN - off < SM3_DIGEST_SIZE ? SM3_DRBG_SEEDLEN - off : SM3_DIGEST_SIZE;
+        memcpy(out + off, d, n);
+    }
+}
+
+// C = Hash_df(0x00 || V), reseed_counter = 1
+static inline void sm3_drbg_derive_c(SM3_DRBG *d) {
+    static const uint8_t zero = 0x00;
+    const uint8_t *in[4] = { &zero, d->V, NULL, NULL };
+    const size_t len[4] = { 1, SM3_DRBG_SEEDLEN, 0, 0 };
+    sm3_drbg_hash_df(in, len, d->C);
+    d->reseed_counter = 1;
+}
+
+static inline void sm3_drbg_instantiate(SM3_DRBG *d, const uint8_t *entropy, size_t entropy_len,
+                                        const uint8_t *nonce, size_t nonce_len,
+                                        const uint8_t *pers, size_t pers_len) {
+    const uint8_t *in[4] = { entropy, nonce, pers, NULL };
+    const size_t len[4] = { entropy_len, nonce_len, pers_len, 0 };
+    sm3_drbg_hash_df(in, len, d->V);
+    sm3_drbg_derive_c(d);
+}
+
+static inline void sm3_drbg_reseed(SM3_DRBG *d, const uint8_t *entropy, size_t entropy_len,
+                                   const uint8_t *add, size_t add_len) {
+    static const uint8_t one = 0x01;
+    uint8_t V[SM3_DRBG_SEEDLEN];
+    memcpy(V, d->V, SM3_DRBG_SEEDLEN);
+    const uint8_t *in[4] = { &one, V, entropy, add };
+    const size_t len[4] = { 1, SM3_DRBG_SEEDLEN, entropy_len, add_len };
+    sm3_drbg_hash_df(in, len, d->V);
+    sm3_drbg_derive_c(d);
+}
+
+// Returns 0; 1 if a reseed is required first; -1 if len > SM3_DRBG_MAX_REQUEST.
+// mgr may be NULL to hash on the scalar path.
+static inline int sm3_drbg_generate(SM3_DRBG *d, SM3_MB_MGR *mgr, uint8_t *out, size_t len,
+                                    const uint8_t *add, size_t add_len) {
+    if (len > SM3_DRBG_MAX_REQUEST) return -1;
+    if (d->reseed_counter > SM3_DRBG_RESEED_INTERVAL) return 1;
+
+    uint8_t w[SM3_DIGEST_SIZE];
+    if (add_len > 0) {
+        static const uint8_t two = 0x02;
+        SM3_CTX ctx;
+        sm3_init(&ctx);
+        sm3_update(&ctx, &two, 1);
+        sm3_update(&ctx, d->V, SM3_DRBG_SEEDLEN);
+        sm3_update(&ctx, add, add_len);
+        sm3_final(&ctx, w);
+        sm3_drbg_add(d->V, w, SM3_DIGEST_SIZE);
+    }
+
+    // Hashgen: out = SM3(V) || SM3(V+1) || ...
+    uint8_t data[SM3_DRBG_BATCH][SM3_DRBG_SEEDLEN];
+    const uint8_t *msgs[SM3_DRBG_BATCH];
+    size_t lens[SM3_DRBG_BATCH];
+    uint8_t digests[SM3_DRBG_BATCH][SM3_DIGEST_SIZE];
+    static const uint8_t one = 0x01;
+    size_t m = (len + SM3_DIGEST_SIZE - 1) / SM3_DIGEST_SIZE;
+    memcpy(data[0], d->V, SM3_DRBG_SEEDLEN);
+    for (size_t i = 0; i < SM3_DRBG_BATCH; ++i) { msgs[i] = data[i]; lens[i] = SM3_DRBG_SEEDLEN; }
+    for (size_t off = 0; off < m; off += SM3_DRBG_BATCH) {
+        size_t k = (m - off < SM3_DRBG_BATCH) ? m - off : SM3_DRBG_BATCH;
+        if (off > 0) {
+            memcpy(data[0], data[SM3_DRBG_BATCH - 1], SM3_DRBG_SEEDLEN);
+            sm3_drbg_add(data[0], &one, 1);
+        }
+        for (size_t i = 1; i < k; ++i) {
+            memcpy(data[i], data[i - 1], SM3_DRBG_SEEDLEN);
+            sm3_drbg_add(data[i], &one, 1);
+        }
+        if (mgr) sm3_mb_hash_many(mgr, msgs, lens, k, digests);
+        else for (size_t i = 0; i < k; ++i) sm3_hash(data[i], SM3_DRBG_SEEDLEN, digests[i]);
+        size_t bytes = (len - off * SM3_DIGEST_SIZE < k * SM3_DIGEST_SIZE) ? len - off * SM3_DIGEST_SIZE
+                                                                           : k * SM3_DIGEST_SIZE;
+        memcpy(out + off * SM3_DIGEST_SIZE, digests, bytes);
+    }
+
+    // V = V + SM3(0x03 || V) + C + reseed_counter
+    static const uint8_t three = 0x03;
+    uint8_t rc[8];
+    SM3_CTX ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, &three, 1);
+    sm3_update(&ctx, d->V, SM3_DRBG_SEEDLEN);
+    sm3_final(&ctx, w);
+    for (int i = 0; i < 8; ++i) rc[i] = (uint8_t)(d->reseed_counter >> (56 - 8*i));
+    sm3_drbg_add(d->V, w, SM3_DIGEST_SIZE);
+    sm3_drbg_add(d->V, d->C, SM3_DRBG_SEEDLEN);
+    sm3_drbg_add(d->V, rc, sizeof(rc));
+    d->reseed_counter++;
+
+    memset(data, 0, sizeof(data));
+    memset(digests, 0, sizeof(digests));
+    __asm__ __volatile__("" : : "r"(data), "r"(digests) : "memory");   // keep the wipes
+    return 0;
+}
+
+// ------------------ per-thread buffered front end ------------------
+
+typedef struct {
+    SM3_DRBG drbg;
+    SM3_MB_MGR mgr;
+    uint8_t pool[SM3_DRBG_POOL];
+    size_t pos;          // next unused byte of pool
+    pid_t pid;           // process that seeded drbg; 0: never seeded
+} SM3_DRBG_THREAD;
+
+static __thread SM3_DRBG_THREAD sm3_drbg_tls;
+static pthread_once_t sm3_drbg_atfork_once = PTHREAD_ONCE_INIT;
+
+// Runs in the child on the forking thread, the only thread the child has.
+static void sm3_drbg_atfork_child(void) {
+    SM3_DRBG_THREAD *t = &sm3_drbg_tls;
+    memset(t->pool, 0, sizeof(t->pool));
+    t->pos = SM3_DRBG_POOL;
+    if (t->pid != 0) t->pid = -1;   // reseed before the next refill
+}
+
+static void sm3_drbg_register_atfork(void) {
+    pthread_atfork(NULL, NULL, sm3_drbg_atfork_child);
+}
+
+static inline int sm3_drbg_getentropy(uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t r = getrandom(buf, len, 0);
+        if (r < 0) return -1;
+        buf += r; len -= (size_t)r;
+    }
+    return 0;
+}
+
+// Returns 0, or -1 if the OS entropy source fails.
+static inline int sm3_drbg_refill(SM3_DRBG_THREAD *t) {
+    uint8_t entropy[SM3_DRBG_ENTROPY_LEN + 16];
+    pid_t pid = getpid();
+    if (t->pid != pid) {
+        pthread_once(&sm3_drbg_atfork_once, sm3_drbg_register_atfork);
+        // entropy || nonce, personalised with pid and thread address
+        uintptr_t pers[2] = { (uintptr_t)pid, (uintptr_t)t };
+        if (sm3_drbg_getentropy(entropy, sizeof(entropy)) != 0) return -1;
+        if (t->pid == 0) {
+            sm3_mb_init(&t->mgr);
+            sm3_drbg_instantiate(&t->drbg, entropy, SM3_DRBG_ENTROPY_LEN, entropy + SM3_DRBG_ENTROPY_LEN, 16,
+                                 (const uint8_t *)pers, sizeof(pers));
+        } else {
+            sm3_drbg_reseed(&t->drbg, entropy, sizeof(entropy), (const uint8_t *)pers, sizeof(pers));
+        }
+        t->pid = pid;
+    }
+    if (sm3_drbg_generate(&t->drbg, &t->mgr, t->pool, SM3_DRBG_POOL, NULL, 0) == 1) {
+        if (sm3_drbg_getentropy(entropy, SM3_DRBG_ENTROPY_LEN) != 0) return -1;
+        sm3_drbg_reseed(&t->drbg, entropy, SM3_DRBG_ENTROPY_LEN, NULL, 0);
+        sm3_drbg_generate(&t->drbg, &t->mgr, t->pool, SM3_DRBG_POOL, NULL, 0);
+    }
+    memset(entropy, 0, sizeof(entropy));
+    t->pos = 0;
+    return 0;
+}
+
+// Fill buf with len random bytes from this thread's pool. Lock-free: the only
+// shared state is the OS entropy source, touched on (re)seed. Returns 0, or -1
+// if seeding fails (buf is then left unspecified).
+static inline int sm3_drbg_rand_bytes(uint8_t *buf, size_t len) {
+    SM3_DRBG_THREAD *t = &sm3_drbg_tls;
+    while (len > 0) {
+        if (t->pid == 0 || t->pos == SM3_DRBG_POOL) {
+            if (sm3_drbg_refill(t) != 0) return -1;
+        }
+        size_t n = SM3_DRBG_POOL - t->pos;
+        if (n > len) n = len;
+        memcpy(buf, t->pool + t->pos, n);
+        memset(t->pool + t->pos, 0, n);   // handed-out bytes never stay behind
+        t->pos += n; buf += n; len -= n;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "sm3.h"
+#include "sm3_hmac.h"
+
+// gcc -O2 sm3_hmac.c -o sm3_hmac
+
+static void print_hex(const uint8_t *d, size_t n) {
+    for (size_t i = 0; i < n; ++i) printf("%02x", d[i]);
+    printf("\n");
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int hex_equal(const uint8_t *d, const char *hex) {
+    char buf[SM3_DIGEST_SIZE * 2 + 1];
+    for (int i = 0; i < SM3_DIGEST_SIZE; ++i) sprintf(buf + 2*i, "%02x", d[i]);
+    return strcmp(buf, hex) == 0;
+}
+
+// textbook HMAC: both pad blocks are rebuilt and compressed for every message
+static void hmac_naive(const uint8_t *key, size_t key_len, const uint8_t *msg, size_t len,
+                       uint8_t mac[SM3_DIGEST_SIZE]) {
+    uint8_t kb[SM3_BLOCK_SIZE] = {0}, pad[SM3_BLOCK_SIZE], inner[SM3_DIGEST_SIZE];
+    if (key_len > SM3_BLOCK_SIZE) sm3_hash(key, key_len, kb);
+    else memcpy(kb, key, key_len);
+    SM3_CTX ctx;
+    for (int i = 0; i < SM3_BLOCK_SIZE; ++i) pad[i] = kb[i] ^ 0x36;
+    sm3_init(&ctx);
+    sm3_update(&ctx, pad, SM3_BLOCK_SIZE);
+    sm3_update(&ctx, msg, len);
+    sm3_final(&ctx, inner);
+    for (int i = 0; i < SM3_BLOCK_SIZE; ++i) pad[i] = kb[i] ^ 0x5c;
+    sm3_init(&ctx);
+    sm3_update(&ctx, pad, SM3_BLOCK_SIZE);
+    sm3_update(&ctx, inner, SM3_DIGEST_SIZE);
+    sm3_final(&ctx, mac);
+}
+
+void hmac_test_and_benchmark(void) {
+    SM3_HMAC_KEY key;
+    uint8_t mac[SM3_DIGEST_SIZE];
+
+    const char *fox = "The quick brown fox jumps over the lazy dog";
+    sm3_hmac_key_init(&key, (const uint8_t *)"key", 3);
+    sm3_hmac(&key, (const uint8_t *)fox, strlen(fox), mac);
+    printf("HMAC-SM3(\"key\", fox)  = "); print_hex(mac, SM3_DIGEST_SIZE);
+    printf("vector 1: %s\n",
+           hex_equal(mac, "bd4a34077888162b210645b8ebf74b9af357303789357a27c7fc457244ebd398") ? "OK" : "FAIL");
+
+    // key longer than one block is hashed first
+    uint8_t long_key[100];
+    memset(long_key, 'k', sizeof(long_key));
+    sm3_hmac_key_init(&key, long_key, sizeof(long_key));
+    sm3_hmac(&key, (const uint8_t *)"abc", 3, mac);
+    printf("HMAC-SM3(100*'k', abc) = "); print_hex(mac, SM3_DIGEST_SIZE);
+    printf("vector 2: %s\n",
+           hex_equal(mac, "2d87dd3ffa1452e8e40d9123a02824fb7dd98ae4a52683287245f1736dc610ef") ? "OK" : "FAIL");
+
+    // cached-key path and batch path against the textbook construction
+    const size_t n = 10000, max_len = 300;
+    const uint8_t *k16 = (const uint8_t *)"0123456789abcdef";
+    uint8_t *pool = malloc(max_len + n);
+    const uint8_t **msgs = malloc(n * sizeof(*msgs));
+    size_t *lens = malloc(n * sizeof(*lens));
+    uint8_t (*ref)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    uint8_t (*out)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    uint32_t seed = 2024;
+    for (size_t i = 0; i < max_len + n; ++i) { seed = seed * 1103515245 + 12345; pool[i] = (uint8_t)(seed >> 16); }
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        msgs[i] = pool + i;
+        lens[i] = (seed >> 8) % (max_len + 1);
+    }
+    sm3_hmac_key_init(&key, k16, 16);
+    int ok = 1;
+    for (size_t i = 0; i < n; ++i) {
+        hmac_naive(k16, 16, msgs[i], lens[i], ref[i]);
+        sm3_hmac(&key, msgs[i], lens[i], mac);
+        ok &= memcmp(mac, ref[i], SM3_DIGEST_SIZE) == 0;
+    }
+    printf("cached key == naive: %s\n", ok ? "YES" : "NO");
+
+    SM3_MB_MGR mgr;
+    sm3_mb_init(&mgr);
+    sm3_hmac_batch(&mgr, &key, msgs, lens, n, out);
+    printf("batch (%d lanes) == naive: %s\n", mgr.lanes,
+           memcmp(out, ref, n * SM3_DIGEST_SIZE) == 0 ? "YES" : "NO");
+
+    // throughput on short messages, where the pad blocks dominate
+    const size_t bench_n = 200000, bench_len = 32;
+    uint8_t *bench = malloc(bench_n * bench_len);
+    const uint8_t **bmsgs = malloc(bench_n * sizeof(*bmsgs));
+    size_t *blens = malloc(bench_n * sizeof(*blens));
+    uint8_t (*bout)[SM3_DIGEST_SIZE] = malloc(bench_n * SM3_DIGEST_SIZE);
+    for (size_t i = 0; i < bench_n * bench_len; ++i) bench[i] = (uint8_t)i;
+    for (size_t i = 0; i < bench_n; ++i) { bmsgs[i] = bench + i * bench_len; blens[i] = bench_len; }
+
+    double t0 = now_sec();
+    for (size_t i = 0; i < bench_n; ++i) hmac_naive(k16, 16, bmsgs[i], blens[i], bout[i]);
+    double t1 = now_sec();
+    printf("naive  HMAC (%zu B): %.2f M msgs/s\n", bench_len, bench_n / (t1 - t0) / 1e6);
+
+    t0 = now_sec();
+    for (size_t i = 0; i < bench_n; ++i) sm3_hmac(&key, bmsgs[i], blens[i], bout[i]);
+    t1 = now_sec();
+    printf("cached HMAC (%zu B): %.2f M msgs/s\n", bench_len, bench_n / (t1 - t0) / 1e6);
+
+    t0 = now_sec();
+    sm3_hmac_batch(&mgr, &key, bmsgs, blens, bench_n, bout);
+    t1 = now_sec();
+    printf("batch  HMAC (%zu B): %.2f M msgs/s\n", bench_len, bench_n / (t1 - t0) / 1e6);
+
+    free(pool); free(msgs); free(lens); free(ref); free(out);
+    free(bench); free(bmsgs); free(blens); free(bout);
+}
+
+int main(void) {
+    hmac_test_and_benchmark();
+    return 0;
+}
@@ -0,0 +1,95 @@
+#ifndef SM3_HMAC_H
+#define SM3_HMAC_H
+
+// HMAC-SM3 (RFC 2104 construction over SM3, 64-byte block).
+//
+// HMAC(K, m) = SM3((K ^ opad) || SM3((K ^ ipad) || m)). The two 64-byte pad
+// blocks depend only on the key, so sm3_hmac_key_init compresses each once
+// and keeps the resulting midstates. Every message then starts from a copy of
+// them, the same way attack.c resumes an SM3_CTX from a saved state and
+// total_len. For a message of at most 55 bytes this leaves 2 compressions
+// instead of 4. sm3_hmac_batch runs both passes through the multi-buffer
+// engine.
+
+#include <stdint.h>
+#include <string.h>
+#include "sm3.h"
+#include "sm3_mb.h"
+
+typedef struct {
+    SM3_CTX inner;   // after (K ^ ipad)
+    SM3_CTX outer;   // after (K ^ opad)
+} SM3_HMAC_KEY;
+
+typedef struct {
+    SM3_CTX ctx;
+    const SM3_HMAC_KEY *key;
+} SM3_HMAC_CTX;
+
+static inline void sm3_hmac_key_init(SM3_HMAC_KEY *k, const uint8_t *key, size_t key_len) {
+    uint8_t kb[SM3_BLOCK_SIZE], pad[SM3_BLOCK_SIZE];
+    memset(kb, 0, sizeof(kb));
+    if (key_len > SM3_BLOCK_SIZE) sm3_hash(key, key_len, kb);
+    else if (key_len > 0) memcpy(kb, key, key_len);
+
+    for (int i = 0; i < SM3_BLOCK_SIZE; ++i) pad[i] = kb[i] ^ 0x36;
+    sm3_init(&k->inner);
+    sm3_update(&k->inner, pad, SM3_BLOCK_SIZE);
+    for (int i = 0; i < SM3_BLOCK_SIZE; ++i) pad[i] = kb[i] ^ 0x5c;
+    sm3_init(&k->outer);
+    sm3_update(&k->outer, pad, SM3_BLOCK_SIZE);
+
+    memset(kb, 0, sizeof(kb));
+    memset(pad, 0, sizeof(pad));
+    __asm__ __volatile__("" : : "r"(kb), "r"(pad) : "memory");   // keep the wipes
+}
+
+static inline void sm3_hmac_init(SM3_HMAC_CTX *ctx, const SM3_HMAC_KEY *key) {
+    ctx->ctx = key->inner;
+    ctx->key = key;
+}
+
+static inline void sm3_hmac_update(SM3_HMAC_CTX *ctx, const uint8_t *data, size_t len) {
+    sm3_update(&ctx->ctx, data, len);
+}
+
+static inline void sm3_hmac_final(SM3_HMAC_CTX *ctx, uint8_t mac[SM3_DIGEST_SIZE]) {
+    uint8_t inner[SM3_DIGEST_SIZE];
+    sm3_final(&ctx->ctx, inner);
+    SM3_CTX outer = ctx->key->outer;
+    sm3_update(&outer, inner, SM3_DIGEST_SIZE);
+    sm3_final(&outer, mac);
+}
+
+static inline void sm3_hmac(const SM3_HMAC_KEY *key, const uint8_t *msg, size_t len,
+                            uint8_t mac[SM3_DIGEST_SIZE]) {
+    SM3_HMAC_CTX ctx;
+    sm3_hmac_init(&ctx, key);
+    sm3_hmac_update(&ctx, msg, len);
+    sm3_hmac_final(&ctx, mac);
+}
+
+#define SM3_HMAC_BATCH 256
+
+// macs[k] = HMAC(key, msgs[k]) for n messages under one key. Both the inner
+// and the outer pass go through the multi-buffer lanes, SM3_HMAC_BATCH
+// messages at a time; the outer pass reads the inner digests from macs[] and
+// overwrites them with the final MACs.
+static inline void sm3_hmac_batch(SM3_MB_MGR *mgr, const SM3_HMAC_KEY *key,
+                                  const uint8_t *const *msgs, const size_t *lens,
+                                  size_t n, uint8_t (*macs)[SM3_DIGEST_SIZE]) {
+    const uint8_t *inner[SM3_HMAC_BATCH];
+    size_t inner_lens[SM3_HMAC_BATCH];
+    for (size_t i = 0; i < SM3_HMAC_BATCH; ++i) inner_lens[i] = SM3_DIGEST_SIZE;
+
+    for (size_t off = 0; off < n; off += SM3_HMAC_BATCH) {
+        size_t m = (n - off < SM3_HMAC_BATCH) ? n - off : SM3_HMAC_BATCH;
+        sm3_mb_hash_many_from(mgr, key->inner.state, SM3_BLOCK_SIZE, msgs + off, lens + off, m, macs + off);
+        // a 32-byte message is copied into the lane's padded tail before its
+        // digest is written, so hashing macs[k] in place is safe
+        for (size_t i = 0; i < m; ++i) inner[i] = macs[off + i];
+        sm3_mb_hash_many_from(mgr, key->outer.state, SM3_BLOCK_SIZE, inner, inner_lens, m, macs + off);
+    }
+}
+
+#endif
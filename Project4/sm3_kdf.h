@@ -0,0 +1,86 @@
+#ifndef SM3_KDF_H
+#define SM3_KDF_H
+
+// SM3 key derivation function (GM/T 0003, used by SM2 encryption and key
+// exchange):
+//
+//   K = SM3(Z || ct_1) || SM3(Z || ct_2) || ...   ct_i = i as 32-bit big endian
+//
+// truncated to klen bytes. Z is the same for every counter, so its full
+// blocks are compressed once; each counter block then only hashes the last
+// |Z| mod 64 bytes of Z plus the 4-byte counter. sm3_kdf does this on the
+// scalar path, sm3_kdf_mb hashes the counter blocks in parallel on the
+// multi-buffer lanes. Both write output blocks straight into `out`.
+
+#include <stdint.h>
+#include <string.h>
+#include "sm3.h"
+#include "sm3_mb.h"
+
+#define SM3_KDF_BATCH 256
+
+// Z's tail (< 64 bytes) followed by a counter; SM3_CTX.buffer after Z.
+static inline size_t sm3_kdf_suffix(const SM3_CTX *zctx, uint32_t ct, uint8_t buf[SM3_BLOCK_SIZE + 4]) {
+    memcpy(buf, zctx->buffer, zctx->buffer_len);
+    cpu_to_be32(ct, buf + zctx->buffer_len);
+    return zctx->buffer_len + 4;
+}
+
+// Returns 0, or -1 if klen needs more than 2^32 - 1 counter blocks.
+static inline int sm3_kdf(const uint8_t *z, size_t zlen, uint8_t *out, size_t klen) {
+    if ((uint64_t)klen > (uint64_t)0xffffffffU * SM3_DIGEST_SIZE) return -1;
+    SM3_CTX zctx;
+    sm3_init(&zctx);
+    sm3_update(&zctx, z, zlen);
+
+    uint8_t ct_be[4], last[SM3_DIGEST_SIZE];
+    for (uint32_t ct = 1; klen > 0; ++ct) {
+        SM3_CTX ctx = zctx;
+        cpu_to_be32(ct, ct_be);
+        sm3_update(&ctx, ct_be, 4);
+        if (klen >= SM3_DIGEST_SIZE) {
+            sm3_final(&ctx, out);
+            out += SM3_DIGEST_SIZE; klen -= SM3_DIGEST_SIZE;
+        } else {
+            sm3_final(&ctx, last);
+            memcpy(out, last, klen);
+            klen = 0;
+        }
+    }
+    return 0;
+}
+
+// Same output as sm3_kdf; counters are hashed SM3_KDF_BATCH at a time across
+// the lanes of mgr, each lane starting from the midstate after Z's full blocks.
+static inline int sm3_kdf_mb(SM3_MB_MGR *mgr, const uint8_t *z, size_t zlen, uint8_t *out, size_t klen) {
+    if ((uint64_t)klen > (uint64_t)0xffffffffU * SM3_DIGEST_SIZE) return -1;
+    SM3_CTX zctx;
+    sm3_init(&zctx);
+    sm3_update(&zctx, z, zlen);
+    uint64_t prefix_len = zctx.total_len - zctx.buffer_len;
+
+    uint8_t suffix[SM3_KDF_BATCH][SM3_BLOCK_SIZE + 4];
+    const uint8_t *msgs[SM3_KDF_BATCH];
+    size_t lens[SM3_KDF_BATCH];
+    uint8_t last[SM3_DIGEST_SIZE];
+    size_t full = klen / SM3_DIGEST_SIZE, rest = klen % SM3_DIGEST_SIZE;
+    size_t nblocks = full + (rest ? 1 : 0);
+
+    for (size_t i = 0; i < SM3_KDF_BATCH; ++i) msgs[i] = suffix[i];
+    for (size_t off = 0; off < nblocks; off += SM3_KDF_BATCH) {
+        size_t m = (nblocks - off < SM3_KDF_BATCH) ? nblocks - off : SM3_KDF_BATCH;
+        for (size_t i = 0; i < m; ++i) lens[i] = sm3_kdf_suffix(&zctx, (uint32_t)(off + i + 1), suffix[i]);
+        // whole digests go directly to out; a truncated last one via `last`
+        size_t direct = (off + m <= full) ? m : full - off;
+        sm3_mb_hash_many_from(mgr, zctx.state, prefix_len, msgs, lens, direct,
+                              (uint8_t (*)[SM3_DIGEST_SIZE])(out + off * SM3_DIGEST_SIZE));
+        if (direct < m) {
+            sm3_mb_hash_many_from(mgr, zctx.state, prefix_len, msgs + direct, lens + direct, 1,
+                                  (uint8_t (*)[SM3_DIGEST_SIZE])last);
+            memcpy(out + full * SM3_DIGEST_SIZE, last, rest);
+        }
+    }
+    return 0;
+}
+
+#endif
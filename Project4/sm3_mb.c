@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "sm3.h"
+#include "sm3_mb.h"
+
+// ------------------ tests & benchmark ------------------
+static void print_hex(const uint8_t *d, size_t n) {
+    for (size_t i = 0; i < n; ++i) printf("%02x", d[i]);
+    printf("\n");
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ref65[k] = SM3(msgs[k][0..65)); sm3_mb_hash65_many is checked on every
+// count up to 40 (short, full and partial lane groups) and on all n messages
+static int check_kernel(const char *name, SM3_MB_MGR *mgr, const uint8_t *const *msgs,
+                        const size_t *lens, size_t n, uint8_t (*ref)[SM3_DIGEST_SIZE],
+                        uint8_t (*ref65)[SM3_DIGEST_SIZE]) {
+    uint8_t (*out)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    sm3_mb_hash_many(mgr, msgs, lens, n, out);
+    int ok = memcmp(out, ref, n * SM3_DIGEST_SIZE) == 0;
+    int ok65 = 1;
+    for (size_t m = 0; m <= 40; ++m) {
+        sm3_mb_hash65_many(mgr, msgs, m, out);
+        ok65 &= memcmp(out, ref65, m * SM3_DIGEST_SIZE) == 0;
+    }
+    sm3_mb_hash65_many(mgr, msgs, n, out);
+    ok65 &= memcmp(out, ref65, n * SM3_DIGEST_SIZE) == 0;
+    printf("%-12s %2d lanes: %s, 65-byte path %s\n", name, mgr->lanes, ok ? "match" : "MISMATCH",
+           ok65 ? "match" : "MISMATCH");
+    free(out);
+    return ok && ok65;
+}
+
+void mb_test_and_benchmark(void) {
+    // variable-length messages (0..1000 bytes) to exercise lane refills
+    const size_t n = 20000;
+    const size_t max_len = 1000;
+    uint8_t *pool = malloc(max_len + n);
+    const uint8_t **msgs = malloc(n * sizeof(*msgs));
+    size_t *lens = malloc(n * sizeof(*lens));
+    uint8_t (*ref)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    uint8_t (*ref65)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < max_len + n; ++i) { seed = seed * 1103515245 + 12345; pool[i] = (uint8_t)(seed >> 16); }
+    for (size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245 + 12345;
+        msgs[i] = pool + i;
+        lens[i] = (seed >> 8) % (max_len + 1);
+    }
+
+    sm3_hash((const uint8_t *)"abc", 3, ref[0]);
+    printf("scalar abc : "); print_hex(ref[0], SM3_DIGEST_SIZE);
+
+    for (size_t i = 0; i < n; ++i) sm3_hash(msgs[i], lens[i], ref[i]);
+    for (size_t i = 0; i < n; ++i) sm3_hash(msgs[i], 65, ref65[i]);
+
+    SM3_MB_MGR mgr;
+    sm3_mb_init_with(&mgr, sm3_mb_x4_scalar, NULL, 4);
+    check_kernel("x4 scalar", &mgr, msgs, lens, n, ref, ref65);
+#ifdef SM3_HAVE_MB_SIMD
+    __builtin_cpu_init();
+    sm3_mb_init_with(&mgr, sm3_mb_x4_sse, sm3_mb_x4_sse_pad65, 4);
+    check_kernel("x4 sse", &mgr, msgs, lens, n, ref, ref65);
+    if (__builtin_cpu_supports("avx2")) {
+        sm3_mb_init_with(&mgr, sm3_mb_x8_avx2, sm3_mb_x8_avx2_pad65, 8);
+        check_kernel("x8 avx2", &mgr, msgs, lens, n, ref, ref65);
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        sm3_mb_init_with(&mgr, sm3_mb_x16_avx512, sm3_mb_x16_avx512_pad65, 16);
+        check_kernel("x16 avx512", &mgr, msgs, lens, n, ref, ref65);
+    }
+#endif
+
+    // throughput on many short messages (typical Merkle leaves)
+    const size_t bench_n = 200000, bench_len = 64;
+    uint8_t *bench = malloc(bench_n * bench_len);
+    const uint8_t **bmsgs = malloc(bench_n * sizeof(*bmsgs));
+    size_t *blens = malloc(bench_n * sizeof(*blens));
+    uint8_t (*bout)[SM3_DIGEST_SIZE] = malloc(bench_n * SM3_DIGEST_SIZE);
+    for (size_t i = 0; i < bench_n * bench_len; ++i) bench[i] = (uint8_t)i;
+    for (size_t i = 0; i < bench_n; ++i) { bmsgs[i] = bench + i * bench_len; blens[i] = bench_len; }
+
+    double t0 = now_sec();
+    for (size_t i = 0; i < bench_n; ++i) sm3_hash(bmsgs[i], blens[i], bout[i]);
+    double t1 = now_sec();
+    printf("scalar     : %.2f M msgs/s (%zu-byte messages)\n", bench_n / (t1 - t0) / 1e6, bench_len);
+
+    sm3_mb_init(&mgr);
+    t0 = now_sec();
+    sm3_mb_hash_many(&mgr, bmsgs, blens, bench_n, bout);
+    t1 = now_sec();
+    printf("mb x%-2d     : %.2f M msgs/s (%zu-byte messages)\n", mgr.lanes, bench_n / (t1 - t0) / 1e6, bench_len);
+
+    free(bench); free(bmsgs); free(blens); free(bout);
+    free(pool); free(msgs); free(lens); free(ref); free(ref65);
+}
+
+int main(void) {
+    mb_test_and_benchmark();
+    return 0;
+}
@@ -0,0 +1,374 @@
+#ifndef SM3_MB_H
+#define SM3_MB_H
+
+// Multi-buffer SM3: hash many independent messages in parallel SIMD lanes.
+// Output is bit-identical to sm3_hash() from sm3.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "sm3.h"
+
+// ------------------ multi-buffer kernels ------------------
+// Each kernel compresses one block in each of LANES independent streams.
+// State is word-major ("transposed"): state[w][lane], so word w of every lane
+// loads as one vector. Rows are SM3_MB_MAX_LANES wide regardless of kernel.
+#define SM3_MB_MAX_LANES 16
+
+typedef void (*sm3_mb_kernel_fn)(uint32_t state[8][SM3_MB_MAX_LANES],
+                                 const uint8_t *blocks[SM3_MB_MAX_LANES]);
+
+// Second block of a 65-byte message in each lane; w0[lane] is
+// SM3_PAD65_W0(last message byte), the only word that differs between lanes.
+typedef void (*sm3_mb_pad65_fn)(uint32_t state[8][SM3_MB_MAX_LANES],
+                                const uint32_t w0[SM3_MB_MAX_LANES]);
+
+// Generic bodies; V_* must be defined for the vector type before each use.
+// SM3_MB_EXPAND is a bare loop so that an unroll pragma can precede it.
+#define SM3_MB_EXPAND(W) \
+    for (j = 16; j < 68; ++j) { \
+        V t = V_XOR(V_XOR(W[j-16], W[j-9]), V_ROTL(W[j-3], 15)); \
+        t = V_XOR(V_XOR(t, V_ROTL(t, 15)), V_ROTL(t, 23)); \
+        W[j] = V_XOR(V_XOR(t, V_ROTL(W[j-13], 7)), W[j-6]); \
+    }
+
+#define SM3_MB_ROUNDS(W) do { \
+    V A = V_LOAD(state[0]), B = V_LOAD(state[1]), C = V_LOAD(state[2]), D = V_LOAD(state[3]); \
+    V E = V_LOAD(state[4]), F = V_LOAD(state[5]), G = V_LOAD(state[6]), H = V_LOAD(state[7]); \
+    for (j = 0; j < 64; ++j) { \
+        V A12 = V_ROTL(A, 12); \
+        V SS1 = V_ROTL(V_ADD(V_ADD(A12, E), V_SET1(SM3_TJ_ROT[j])), 7); \
+        V SS2 = V_XOR(SS1, A12); \
+        V ff, gg; \
+        if (j < 16) { \
+            ff = V_XOR(V_XOR(A, B), C); \
+            gg = V_XOR(V_XOR(E, F), G); \
+        } else { \
+            ff = V_OR(V_AND(A, B), V_AND(V_OR(A, B), C)); \
+            gg = V_OR(V_AND(E, F), V_ANDNOT(E, G)); \
+        } \
+        V TT1 = V_ADD(V_ADD(ff, D), V_ADD(SS2, V_XOR(W[j], W[j+4]))); \
+        V TT2 = V_ADD(V_ADD(gg, H), V_ADD(SS1, W[j])); \
+        D = C; C = V_ROTL(B, 9); B = A; A = TT1; \
+        H = G; G = V_ROTL(F, 19); F = E; \
+        E = V_XOR(V_XOR(TT2, V_ROTL(TT2, 9)), V_ROTL(TT2, 17)); \
+    } \
+    V_STORE(state[0], V_XOR(A, V_LOAD(state[0]))); V_STORE(state[1], V_XOR(B, V_LOAD(state[1]))); \
+    V_STORE(state[2], V_XOR(C, V_LOAD(state[2]))); V_STORE(state[3], V_XOR(D, V_LOAD(state[3]))); \
+    V_STORE(state[4], V_XOR(E, V_LOAD(state[4]))); V_STORE(state[5], V_XOR(F, V_LOAD(state[5]))); \
+    V_STORE(state[6], V_XOR(G, V_LOAD(state[6]))); V_STORE(state[7], V_XOR(H, V_LOAD(state[7]))); \
+} while (0)
+
+#define SM3_MB_BODY(LANES) do { \
+    uint32_t Mt[16][LANES] __attribute__((aligned(64))); \
+    V W[68]; \
+    int j, i; \
+    for (j = 0; j < 16; ++j) \
+        for (i = 0; i < (LANES); ++i) Mt[j][i] = be32_to_cpu(blocks[i] + j*4); \
+    for (j = 0; j < 16; ++j) W[j] = V_LOAD(Mt[j]); \
+    SM3_MB_EXPAND(W) \
+    SM3_MB_ROUNDS(W); \
+} while (0)
+
+// The padding block has W[1..14] = 0 and a constant W[15]. With the expansion
+// fully unrolled the compiler folds those words away, and there is no
+// transpose: only w0 is loaded.
+#define SM3_MB_PAD65_BODY() do { \
+    V W[68]; \
+    int j; \
+    W[0] = V_LOAD(w0); \
+    for (j = 1; j < 15; ++j) W[j] = V_SET1(0); \
+    W[15] = V_SET1(SM3_PAD65_BITS); \
+    _Pragma("GCC unroll 52") \
+    SM3_MB_EXPAND(W) \
+    SM3_MB_ROUNDS(W); \
+} while (0)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SM3_HAVE_MB_SIMD 1
+
+// 4 lanes, SSE2
+#define V __m128i
+#define V_LOAD(p)     _mm_load_si128((const __m128i *)(p))
+#define V_STORE(p,x)  _mm_store_si128((__m128i *)(p), (x))
+#define V_XOR(a,b)    _mm_xor_si128((a), (b))
+#define V_AND(a,b)    _mm_and_si128((a), (b))
+#define V_OR(a,b)     _mm_or_si128((a), (b))
+#define V_ANDNOT(a,b) _mm_andnot_si128((a), (b))
+#define V_ADD(a,b)    _mm_add_epi32((a), (b))
+#define V_SET1(x)     _mm_set1_epi32((int)(x))
+#define V_ROTL(x,n)   _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+__attribute__((target("sse2")))
+static inline void sm3_mb_x4_sse(uint32_t state[8][SM3_MB_MAX_LANES], const uint8_t *blocks[SM3_MB_MAX_LANES]) {
+    SM3_MB_BODY(4);
+}
+__attribute__((target("sse2")))
+static inline void sm3_mb_x4_sse_pad65(uint32_t state[8][SM3_MB_MAX_LANES], const uint32_t w0[SM3_MB_MAX_LANES]) {
+    SM3_MB_PAD65_BODY();
+}
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ANDNOT
+#undef V_ADD
+#undef V_SET1
+#undef V_ROTL
+
+// 8 lanes, AVX2
+#define V __m256i
+#define V_LOAD(p)     _mm256_load_si256((const __m256i *)(p))
+#define V_STORE(p,x)  _mm256_store_si256((__m256i *)(p), (x))
+#define V_XOR(a,b)    _mm256_xor_si256((a), (b))
+#define V_AND(a,b)    _mm256_and_si256((a), (b))
+#define V_OR(a,b)     _mm256_or_si256((a), (b))
+#define V_ANDNOT(a,b) _mm256_andnot_si256((a), (b))
+#define V_ADD(a,b)    _mm256_add_epi32((a), (b))
+#define V_SET1(x)     _mm256_set1_epi32((int)(x))
+#define V_ROTL(x,n)   _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+__attribute__((target("avx2")))
+static inline void sm3_mb_x8_avx2(uint32_t state[8][SM3_MB_MAX_LANES], const uint8_t *blocks[SM3_MB_MAX_LANES]) {
+    SM3_MB_BODY(8);
+}
+__attribute__((target("avx2")))
+static inline void sm3_mb_x8_avx2_pad65(uint32_t state[8][SM3_MB_MAX_LANES], const uint32_t w0[SM3_MB_MAX_LANES]) {
+    SM3_MB_PAD65_BODY();
+}
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ANDNOT
+#undef V_ADD
+#undef V_SET1
+#undef V_ROTL
+
+// 16 lanes, AVX-512F: rotates are a single vprold
+#define V __m512i
+#define V_LOAD(p)     _mm512_load_si512((const void *)(p))
+#define V_STORE(p,x)  _mm512_store_si512((void *)(p), (x))
+#define V_XOR(a,b)    _mm512_xor_si512((a), (b))
+#define V_AND(a,b)    _mm512_and_si512((a), (b))
+#define V_OR(a,b)     _mm512_or_si512((a), (b))
+#define V_ANDNOT(a,b) _mm512_andnot_si512((a), (b))
+#define V_ADD(a,b)    _mm512_add_epi32((a), (b))
+#define V_SET1(x)     _mm512_set1_epi32((int)(x))
+#define V_ROTL(x,n)   _mm512_rol_epi32((x), (n))
+__attribute__((target("avx512f")))
+static inline void sm3_mb_x16_avx512(uint32_t state[8][SM3_MB_MAX_LANES], const uint8_t *blocks[SM3_MB_MAX_LANES]) {
+    SM3_MB_BODY(16);
+}
+__attribute__((target("avx512f")))
+static inline void sm3_mb_x16_avx512_pad65(uint32_t state[8][SM3_MB_MAX_LANES], const uint32_t w0[SM3_MB_MAX_LANES]) {
+    SM3_MB_PAD65_BODY();
+}
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ANDNOT
+#undef V_ADD
+#undef V_SET1
+#undef V_ROTL
+#endif
+
+// Portable fallback: run the lanes one after another through sm3_compress.
+static inline void sm3_mb_x4_scalar(uint32_t state[8][SM3_MB_MAX_LANES], const uint8_t *blocks[SM3_MB_MAX_LANES]) {
+    for (int i = 0; i < 4; ++i) {
+        uint32_t s[8];
+        for (int w = 0; w < 8; ++w) s[w] = state[w][i];
+        sm3_compress(s, blocks[i]);
+        for (int w = 0; w < 8; ++w) state[w][i] = s[w];
+    }
+}
+
+// ------------------ lane scheduler ------------------
+// One lane = one message in flight. Full blocks are fed straight from the
+// caller's buffer; only the final 1-2 padded blocks are built in tail[].
+typedef struct {
+    const uint8_t *data;      // next unread input byte
+    size_t remaining;         // input bytes not yet fed
+    uint64_t total_len;       // message length in bytes
+    uint8_t tail[SM3_BLOCK_SIZE * 2];
+    int tail_blocks;          // padded blocks in tail[], -1 until built
+    int tail_pos;
+    uint8_t *out;             // where the digest goes
+    int busy;
+} SM3_MB_LANE;
+
+typedef struct {
+    int lanes;
+    sm3_mb_kernel_fn kernel;
+    sm3_mb_pad65_fn pad65;    // NULL: sm3_mb_hash65_many builds padding blocks for kernel
+    uint32_t state[8][SM3_MB_MAX_LANES] __attribute__((aligned(64)));
+    SM3_MB_LANE lane[SM3_MB_MAX_LANES];
+} SM3_MB_MGR;
+
+// Select the widest kernel this CPU supports.
+static inline void sm3_mb_init(SM3_MB_MGR *mgr) {
+    mgr->lanes = 4;
+    mgr->kernel = sm3_mb_x4_scalar;
+    mgr->pad65 = NULL;
+#ifdef SM3_HAVE_MB_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        mgr->lanes = 16; mgr->kernel = sm3_mb_x16_avx512; mgr->pad65 = sm3_mb_x16_avx512_pad65;
+    } else if (__builtin_cpu_supports("avx2")) {
+        mgr->lanes = 8; mgr->kernel = sm3_mb_x8_avx2; mgr->pad65 = sm3_mb_x8_avx2_pad65;
+    } else {
+        mgr->lanes = 4; mgr->kernel = sm3_mb_x4_sse; mgr->pad65 = sm3_mb_x4_sse_pad65;
+    }
+#endif
+}
+
+// pad65 may be NULL.
+static inline void sm3_mb_init_with(SM3_MB_MGR *mgr, sm3_mb_kernel_fn kernel, sm3_mb_pad65_fn pad65, int lanes) {
+    mgr->lanes = lanes;
+    mgr->kernel = kernel;
+    mgr->pad65 = pad65;
+}
+
+static inline void mb_lane_start(SM3_MB_MGR *mgr, int i, const uint32_t iv[8], uint64_t prefix_len,
+                                 const uint8_t *msg, size_t len, uint8_t *out) {
+    SM3_MB_LANE *l = &mgr->lane[i];
+    l->data = msg;
+    l->remaining = len;
+    l->total_len = prefix_len + len;
+    l->tail_blocks = -1;
+    l->tail_pos = 0;
+    l->out = out;
+    l->busy = 1;
+    for (int w = 0; w < 8; ++w) mgr->state[w][i] = iv[w];
+}
+
+// Next block for this lane, or NULL once the padded message is consumed.
+static inline const uint8_t *mb_lane_next_block(SM3_MB_LANE *l) {
+    if (l->remaining >= SM3_BLOCK_SIZE) {
+        const uint8_t *p = l->data;
+        l->data += SM3_BLOCK_SIZE;
+        l->remaining -= SM3_BLOCK_SIZE;
+        return p;
+    }
+    if (l->tail_blocks < 0) {
+        size_t rem = l->remaining;
+        size_t tail_len = (rem < 56) ? SM3_BLOCK_SIZE : SM3_BLOCK_SIZE * 2;
+        uint64_t bits = l->total_len * 8;
+        memset(l->tail, 0, tail_len);
+        memcpy(l->tail, l->data, rem);
+        l->tail[rem] = 0x80;
+        for (int k = 0; k < 8; ++k) l->tail[tail_len - 1 - k] = (uint8_t)(bits >> (8 * k));
+        l->tail_blocks = (int)(tail_len / SM3_BLOCK_SIZE);
+        l->remaining = 0;
+    }
+    if (l->tail_pos < l->tail_blocks) return l->tail + SM3_BLOCK_SIZE * l->tail_pos++;
+    return NULL;
+}
+
+static inline void mb_lane_finish(SM3_MB_MGR *mgr, int i) {
+    for (int w = 0; w < 8; ++w) cpu_to_be32(mgr->state[w][i], mgr->lane[i].out + w*4);
+    mgr->lane[i].busy = 0;
+}
+
+// Like sm3_mb_hash_many, but every message continues from a common midstate:
+// iv is the chaining value after prefix_len bytes (a multiple of the block
+// size) have been compressed, e.g. SM3_CTX.state with buffer_len == 0.
+// Lanes are refilled as soon as their message completes, so messages of very
+// different lengths still keep every lane busy. Once the queue is empty and
+// fewer than half the lanes are live, the stragglers finish on the scalar path.
+static inline void sm3_mb_hash_many_from(SM3_MB_MGR *mgr, const uint32_t iv[8], uint64_t prefix_len,
+                                         const uint8_t *const *msgs, const size_t *lens,
+                                         size_t n, uint8_t (*digests)[SM3_DIGEST_SIZE]) {
+    static const uint8_t idle_block[SM3_BLOCK_SIZE];
+    const uint8_t *blocks[SM3_MB_MAX_LANES];
+    size_t next = 0;
+    int lanes = mgr->lanes, active = 0;
+
+    for (int i = 0; i < lanes; ++i) {
+        mgr->lane[i].busy = 0;
+        if (next < n) { mb_lane_start(mgr, i, iv, prefix_len, msgs[next], lens[next], digests[next]); next++; active++; }
+    }
+
+    while (active > 0) {
+        if (next == n && active * 2 < lanes) break;
+        for (int i = 0; i < lanes; ++i) {
+            SM3_MB_LANE *l = &mgr->lane[i];
+            const uint8_t *p = l->busy ? mb_lane_next_block(l) : NULL;
+            while (l->busy && p == NULL) {
+                mb_lane_finish(mgr, i);
+                active--;
+                if (next < n) {
+                    mb_lane_start(mgr, i, iv, prefix_len, msgs[next], lens[next], digests[next]);
+                    next++; active++;
+                    p = mb_lane_next_block(l);
+                }
+            }
+            blocks[i] = p ? p : idle_block;
+        }
+        if (active == 0) break;
+        mgr->kernel(mgr->state, blocks);
+    }
+
+    for (int i = 0; i < lanes; ++i) {
+        SM3_MB_LANE *l = &mgr->lane[i];
+        if (!l->busy) continue;
+        uint32_t s[8];
+        const uint8_t *p;
+        for (int w = 0; w < 8; ++w) s[w] = mgr->state[w][i];
+        while ((p = mb_lane_next_block(l)) != NULL) sm3_compress(s, p);
+        for (int w = 0; w < 8; ++w) mgr->state[w][i] = s[w];
+        mb_lane_finish(mgr, i);
+    }
+}
+
+// Hash n independent messages; digests[k] = SM3(msgs[k][0..lens[k])).
+static inline void sm3_mb_hash_many(SM3_MB_MGR *mgr, const uint8_t *const *msgs, const size_t *lens,
+                                    size_t n, uint8_t (*digests)[SM3_DIGEST_SIZE]) {
+    sm3_mb_hash_many_from(mgr, SM3_IV, 0, msgs, lens, n, digests);
+}
+
+// digests[k] = SM3(msgs[k][0..65)) for n messages of exactly 65 bytes, e.g.
+// Merkle internal nodes 0x01 || left || right. Every lane runs the same two
+// blocks, so there is no lane scheduling and no tail building: the first block
+// is read in place, the second goes through pad65. A short last group fills
+// its idle lanes with a dummy message.
+static inline void sm3_mb_hash65_many(SM3_MB_MGR *mgr, const uint8_t *const *msgs, size_t n,
+                                      uint8_t (*digests)[SM3_DIGEST_SIZE]) {
+    static const uint8_t idle_msg[65];
+    uint32_t w0[SM3_MB_MAX_LANES] __attribute__((aligned(64)));
+    uint8_t pad[SM3_MB_MAX_LANES][SM3_BLOCK_SIZE];
+    const uint8_t *blocks[SM3_MB_MAX_LANES];
+    int lanes = mgr->lanes;
+
+    for (size_t k = 0; k < n; k += (size_t)lanes) {
+        size_t m = (n - k < (size_t)lanes) ? n - k : (size_t)lanes;
+        for (int i = 0; i < lanes; ++i) {
+            blocks[i] = ((size_t)i < m) ? msgs[k + i] : idle_msg;
+            w0[i] = SM3_PAD65_W0(blocks[i][SM3_BLOCK_SIZE]);
+            for (int w = 0; w < 8; ++w) mgr->state[w][i] = SM3_IV[w];
+        }
+        mgr->kernel(mgr->state, blocks);
+        if (mgr->pad65) {
+            mgr->pad65(mgr->state, w0);
+        } else {
+            for (int i = 0; i < lanes; ++i) {
+                memset(pad[i], 0, SM3_BLOCK_SIZE);
+                cpu_to_be32(w0[i], pad[i]);
+                pad[i][SM3_BLOCK_SIZE - 2] = SM3_PAD65_BITS >> 8;
+                pad[i][SM3_BLOCK_SIZE - 1] = SM3_PAD65_BITS & 0xff;
+                blocks[i] = pad[i];
+            }
+            mgr->kernel(mgr->state, blocks);
+        }
+        for (size_t i = 0; i < m; ++i)
+            for (int w = 0; w < 8; ++w) cpu_to_be32(mgr->state[w][i], digests[k + i] + w*4);
+    }
+}
+
+#endif
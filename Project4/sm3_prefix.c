@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "sm3.h"
+#include "sm3_prefix.h"
+
+// gcc -O2 sm3_prefix.c -o sm3_prefix
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void prefix_test_and_benchmark(void) {
+    const size_t len = 1000;
+    uint8_t *msg = malloc(len);
+    uint8_t ref[SM3_DIGEST_SIZE], d[SM3_DIGEST_SIZE];
+    for (size_t i = 0; i < len; ++i) msg[i] = (uint8_t)(i * 31 + 7);
+    sm3_hash(msg, len, ref);
+
+    // snapshot after every split point, resume from the serialised bytes
+    int ok = 1;
+    for (size_t split = 0; split <= len; ++split) {
+        SM3_CTX a, b;
+        uint8_t snap[SM3_MIDSTATE_SIZE];
+        sm3_init(&a);
+        sm3_update(&a, msg, split);
+        sm3_export(&a, snap);
+        memset(&b, 0xaa, sizeof(b));
+        if (sm3_import(&b, snap) != 0) { ok = 0; break; }
+        sm3_update(&b, msg + split, len - split);
+        sm3_final(&b, d);
+        ok &= memcmp(d, ref, SM3_DIGEST_SIZE) == 0;
+    }
+    printf("export/import at every split: %s\n", ok ? "YES" : "NO");
+
+    SM3_CTX c;
+    uint8_t snap[SM3_MIDSTATE_SIZE];
+    sm3_init(&c);
+    sm3_update(&c, msg, 70);
+    sm3_export(&c, snap);
+    snap[SM3_DIGEST_SIZE + 8] = 5;   // buffer_len no longer matches total_len
+    printf("inconsistent snapshot rejected: %s\n", sm3_import(&c, snap) != 0 ? "YES" : "NO");
+
+    // prefix cache: id path and longest-match path
+    SM3_PREFIX_CACHE cache;
+    sm3_prefix_cache_init(&cache);
+    int id_short = sm3_prefix_register(&cache, msg, 100);
+    int id_long = sm3_prefix_register(&cache, msg, 777);
+    ok = sm3_prefix_register(&cache, msg, 100) == id_short;
+    sm3_prefix_hash_id(&cache, id_long, msg + 777, len - 777, d);
+    ok &= memcmp(d, ref, SM3_DIGEST_SIZE) == 0;
+    ok &= sm3_prefix_find(&cache, msg, len) == id_long;
+    ok &= sm3_prefix_find(&cache, msg, 500) == id_short;
+    for (size_t l = 0; l <= len; ++l) {
+        uint8_t r[SM3_DIGEST_SIZE];
+        sm3_hash(msg, l, r);
+        sm3_prefix_hash(&cache, msg, l, d);
+        ok &= memcmp(d, r, SM3_DIGEST_SIZE) == 0;
+    }
+    printf("prefix cache == plain SM3: %s\n", ok ? "YES" : "NO");
+    sm3_prefix_cache_free(&cache);
+    free(msg);
+
+    // 4 KB header + 32-byte body: 66 compressions per message vs 2 with the cache
+    const size_t hdr_len = 4096, body_len = 32, n = 100000;
+    uint8_t *buf = malloc(hdr_len + body_len);
+    for (size_t i = 0; i < hdr_len + body_len; ++i) buf[i] = (uint8_t)(i ^ 0x5a);
+    sm3_prefix_cache_init(&cache);
+    int id = sm3_prefix_register(&cache, buf, hdr_len);
+
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; ++i) {
+        buf[hdr_len] = (uint8_t)i;
+        sm3_hash(buf, hdr_len + body_len, d);
+        __asm__ __volatile__("" : : "r"(d) : "memory");   // keep the digest
+    }
+    double t1 = now_sec();
+    printf("full message  : %.3f M msgs/s\n", n / (t1 - t0) / 1e6);
+
+    t0 = now_sec();
+    for (size_t i = 0; i < n; ++i) {
+        buf[hdr_len] = (uint8_t)i;
+        sm3_prefix_hash_id(&cache, id, buf + hdr_len, body_len, d);
+        __asm__ __volatile__("" : : "r"(d) : "memory");
+    }
+    t1 = now_sec();
+    printf("cached prefix : %.3f M msgs/s\n", n / (t1 - t0) / 1e6);
+
+    t0 = now_sec();
+    for (size_t i = 0; i < n; ++i) {
+        buf[hdr_len] = (uint8_t)i;
+        sm3_prefix_hash(&cache, buf, hdr_len + body_len, d);
+        __asm__ __volatile__("" : : "r"(d) : "memory");
+    }
+    t1 = now_sec();
+    printf("prefix lookup : %.3f M msgs/s\n", n / (t1 - t0) / 1e6);
+
+    sm3_prefix_cache_free(&cache);
+    free(buf);
+}
+
+int main(void) {
+    prefix_test_and_benchmark();
+    return 0;
+}
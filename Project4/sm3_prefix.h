@@ -0,0 +1,97 @@
+#ifndef SM3_PREFIX_H
+#define SM3_PREFIX_H
+
+// Common-prefix hash cache.
+//
+// Messages that start with a long fixed prefix (a protocol header, an SM2 Z
+// value, ...) recompress the same prefix blocks every time. A registered
+// prefix is hashed once and its SM3_CTX kept; hashing prefix || suffix then
+// starts from a copy of that context and only compresses the suffix (plus the
+// prefix's last partial block, which is still in ctx->buffer). Digests are
+// identical to plain sm3_hash over the whole message.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sm3.h"
+
+typedef struct {
+    uint8_t *prefix;
+    size_t len;
+    SM3_CTX ctx;     // after sm3_update(prefix)
+} SM3_PREFIX_ENTRY;
+
+typedef struct {
+    SM3_PREFIX_ENTRY *entries;
+    size_t count, cap;
+} SM3_PREFIX_CACHE;
+
+static inline void sm3_prefix_cache_init(SM3_PREFIX_CACHE *c) {
+    c->entries = NULL;
+    c->count = c->cap = 0;
+}
+
+static inline void sm3_prefix_cache_free(SM3_PREFIX_CACHE *c) {
+    for (size_t i = 0; i < c->count; ++i) free(c->entries[i].prefix);
+    free(c->entries);
+    sm3_prefix_cache_init(c);
+}
+
+// Register a prefix and return its id; registering the same bytes again
+// returns the existing id. -1 if memory cannot be allocated.
+static inline int sm3_prefix_register(SM3_PREFIX_CACHE *c, const uint8_t *prefix, size_t len) {
+    for (size_t i = 0; i < c->count; ++i)
+        if (c->entries[i].len == len && memcmp(c->entries[i].prefix, prefix, len) == 0) return (int)i;
+
+    if (c->count == c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 8;
+        SM3_PREFIX_ENTRY *e = realloc(c->entries, cap * sizeof(*e));
+        if (!e) return -1;
+        c->entries = e;
+        c->cap = cap;
+    }
+    SM3_PREFIX_ENTRY *e = &c->entries[c->count];
+    e->prefix = malloc(len ? len : 1);
+    if (!e->prefix) return -1;
+    memcpy(e->prefix, prefix, len);
+    e->len = len;
+    sm3_init(&e->ctx);
+    sm3_update(&e->ctx, prefix, len);
+    return (int)c->count++;
+}
+
+// Context positioned after prefix `id`, ready for sm3_update(suffix).
+static inline void sm3_prefix_ctx(const SM3_PREFIX_CACHE *c, int id, SM3_CTX *ctx) {
+    *ctx = c->entries[id].ctx;
+}
+
+// digest = SM3(prefix_id || suffix)
+static inline void sm3_prefix_hash_id(const SM3_PREFIX_CACHE *c, int id, const uint8_t *suffix, size_t len,
+                                      uint8_t digest[SM3_DIGEST_SIZE]) {
+    SM3_CTX ctx = c->entries[id].ctx;
+    sm3_update(&ctx, suffix, len);
+    sm3_final(&ctx, digest);
+}
+
+// Longest registered prefix of msg, or -1. The scan is a memcmp per entry,
+// far cheaper than the compressions it saves, but callers that already know
+// the prefix should use sm3_prefix_hash_id directly.
+static inline int sm3_prefix_find(const SM3_PREFIX_CACHE *c, const uint8_t *msg, size_t len) {
+    int best = -1;
+    for (size_t i = 0; i < c->count; ++i) {
+        const SM3_PREFIX_ENTRY *e = &c->entries[i];
+        if (e->len > len || (best >= 0 && e->len <= c->entries[best].len)) continue;
+        if (memcmp(e->prefix, msg, e->len) == 0) best = (int)i;
+    }
+    return best;
+}
+
+// digest = SM3(msg), reusing the longest registered prefix of msg if any.
+static inline void sm3_prefix_hash(const SM3_PREFIX_CACHE *c, const uint8_t *msg, size_t len,
+                                   uint8_t digest[SM3_DIGEST_SIZE]) {
+    int id = sm3_prefix_find(c, msg, len);
+    if (id < 0) sm3_hash(msg, len, digest);
+    else sm3_prefix_hash_id(c, id, msg + c->entries[id].len, len - c->entries[id].len, digest);
+}
+
+#endif
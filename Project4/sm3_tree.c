@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "sm3.h"
+#include "sm3_tree.h"
+
+// gcc -O2 sm3_tree.c -o sm3_tree -lpthread
+
+static void print_hex(const uint8_t *d, size_t n) {
+    for (size_t i = 0; i < n; ++i) printf("%02x", d[i]);
+    printf("\n");
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void tree_test_and_benchmark(void) {
+    uint8_t d1[SM3_DIGEST_SIZE], d2[SM3_DIGEST_SIZE];
+
+    // one chunk: digest is the leaf hash itself
+    sm3_tree_hash((const uint8_t *)"abc", 3, 1, d1);
+    sm3_tree_leaf((const uint8_t *)"abc", 3, d2);
+    printf("SM3-TREE(\"abc\") = "); print_hex(d1, SM3_DIGEST_SIZE);
+    printf("single chunk == leaf: %s\n", memcmp(d1, d2, SM3_DIGEST_SIZE) == 0 ? "YES" : "NO");
+
+    // odd chunk count: last chunk is carried up one level
+    size_t len3 = 2 * SM3_TREE_CHUNK_SIZE + 5;
+    uint8_t *buf3 = malloc(len3);
+    for (size_t i = 0; i < len3; ++i) buf3[i] = (uint8_t)(i * 7);
+    uint8_t l0[SM3_DIGEST_SIZE], l1[SM3_DIGEST_SIZE], l2[SM3_DIGEST_SIZE], p01[SM3_DIGEST_SIZE];
+    sm3_tree_leaf(buf3, SM3_TREE_CHUNK_SIZE, l0);
+    sm3_tree_leaf(buf3 + SM3_TREE_CHUNK_SIZE, SM3_TREE_CHUNK_SIZE, l1);
+    sm3_tree_leaf(buf3 + 2 * SM3_TREE_CHUNK_SIZE, 5, l2);
+    sm3_tree_parent(l0, l1, p01);
+    sm3_tree_parent(p01, l2, d2);
+    sm3_tree_hash(buf3, len3, 0, d1);
+    printf("3-chunk tree by hand: %s\n", memcmp(d1, d2, SM3_DIGEST_SIZE) == 0 ? "YES" : "NO");
+    free(buf3);
+
+    // same digest for every thread count; throughput vs plain SM3
+    const size_t len = 256u << 20;
+    uint8_t *data = malloc(len);
+    for (size_t i = 0; i < len; ++i) data[i] = (uint8_t)(i ^ (i >> 11));
+
+    double t0 = now_sec();
+    sm3_hash(data, len, d1);
+    double t1 = now_sec();
+    printf("plain SM3       : %.1f MB/s\n", len / (1024.0 * 1024.0) / (t1 - t0));
+
+    uint8_t ref[SM3_DIGEST_SIZE];
+    int same = 1;
+    const int threads[] = { 1, 2, 4, 8, 0 };
+    for (size_t k = 0; k < sizeof(threads) / sizeof(threads[0]); ++k) {
+        t0 = now_sec();
+        sm3_tree_hash(data, len, threads[k], d1);
+        t1 = now_sec();
+        if (k == 0) memcpy(ref, d1, SM3_DIGEST_SIZE);
+        else same &= memcmp(ref, d1, SM3_DIGEST_SIZE) == 0;
+        int t = threads[k] > 0 ? threads[k] : pool_default_threads();
+        printf("SM3-TREE %3d thr: %.1f MB/s\n", t, len / (1024.0 * 1024.0) / (t1 - t0));
+    }
+    printf("SM3-TREE(256MB) = "); print_hex(ref, SM3_DIGEST_SIZE);
+    printf("independent of thread count: %s\n", same ? "YES" : "NO");
+    free(data);
+}
+
+int main(void) {
+    tree_test_and_benchmark();
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef SM3_TREE_H
+#define SM3_TREE_H
+
+// SM3-TREE: an optional parallel tree-hash digest. It is NOT plain SM3 and
+// produces different digests; use it only where both sides agree on it.
+//
+//   leaf_i = SM3(0x00 || chunk_i)          chunk_i = bytes [i*C, (i+1)*C)
+//   parent = SM3(0x01 || left || right)
+//
+// C = SM3_TREE_CHUNK_SIZE (1 MiB). Parents are formed level by level, pairing
+// left to right and carrying an odd last node up unchanged. That gives the
+// same shape as RFC 6962's split at the largest power of two below n, i.e.
+// the tree merkle_hash_node builds in Merkle.c. Empty input is a single
+// empty chunk. The 0x00/0x01 prefixes keep leaf and parent
+// hashes from colliding. Chunks and each level are hashed on the
+// work-stealing pool; the digest does not depend on the thread count.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sm3.h"
+#include "thread_pool.h"
+
+#define SM3_TREE_CHUNK_SIZE (1u << 20)
+#define SM3_TREE_LEAF   0x00
+#define SM3_TREE_PARENT 0x01
+
+static inline void sm3_tree_leaf(const uint8_t *chunk, size_t len, uint8_t out[SM3_DIGEST_SIZE]) {
+    static const uint8_t prefix = SM3_TREE_LEAF;
+    SM3_CTX ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, &prefix, 1);
+    sm3_update(&ctx, chunk, len);
+    sm3_final(&ctx, out);
+}
+
+static inline void sm3_tree_parent(const uint8_t left[SM3_DIGEST_SIZE], const uint8_t right[SM3_DIGEST_SIZE],
+                                   uint8_t out[SM3_DIGEST_SIZE]) {
+    uint8_t buf[1 + SM3_DIGEST_SIZE * 2];
+    buf[0] = SM3_TREE_PARENT;
+    memcpy(buf + 1, left, SM3_DIGEST_SIZE);
+    memcpy(buf + 1 + SM3_DIGEST_SIZE, right, SM3_DIGEST_SIZE);
+    sm3_hash(buf, sizeof(buf), out);
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    const uint8_t (*in)[SM3_DIGEST_SIZE];
+    uint8_t (*out)[SM3_DIGEST_SIZE];
+} SM3_TREE_JOB;
+
+static inline void sm3_tree_leaf_task(void *arg, size_t begin, size_t end) {
+    SM3_TREE_JOB *job = arg;
+    for (size_t i = begin; i < end; ++i) {
+        size_t off = i * (size_t)SM3_TREE_CHUNK_SIZE;
+        size_t n = (job->len - off < SM3_TREE_CHUNK_SIZE) ? job->len - off : SM3_TREE_CHUNK_SIZE;
+        sm3_tree_leaf(job->data + off, n, job->out[i]);
+    }
+}
+
+static inline void sm3_tree_parent_task(void *arg, size_t begin, size_t end) {
+    SM3_TREE_JOB *job = arg;
+    for (size_t i = begin; i < end; ++i) sm3_tree_parent(job->in[2*i], job->in[2*i + 1], job->out[i]);
+}
+
+// Tree-hash len bytes on nthreads threads (<= 0: one per CPU).
+// Returns 0, or -1 if the per-chunk digest array cannot be allocated.
+static inline int sm3_tree_hash(const uint8_t *data, size_t len, int nthreads,
+                                uint8_t out[SM3_DIGEST_SIZE]) {
+    size_t n = (len + SM3_TREE_CHUNK_SIZE - 1) / SM3_TREE_CHUNK_SIZE;
+    if (n == 0) n = 1;
+    uint8_t (*a)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    uint8_t (*b)[SM3_DIGEST_SIZE] = malloc(((n + 1) / 2) * SM3_DIGEST_SIZE);
+    if (!a || !b) {
+        free(a); free(b);
+        return -1;
+    }
+
+    SM3_TREE_JOB job = { data, len, NULL, a };
+    pool_parallel_for(n, 1, nthreads, sm3_tree_leaf_task, &job);
+
+    // ping-pong between a and b, one level per pass
+    while (n > 1) {
+        size_t pairs = n / 2;
+        job.in = (const uint8_t (*)[SM3_DIGEST_SIZE])a;
+        job.out = b;
+        pool_parallel_for(pairs, 256, nthreads, sm3_tree_parent_task, &job);
+        if (n & 1) memcpy(b[pairs], a[n - 1], SM3_DIGEST_SIZE);
+        n = pairs + (n & 1);
+        uint8_t (*t)[SM3_DIGEST_SIZE] = a; a = b; b = t;
+    }
+    memcpy(out, a[0], SM3_DIGEST_SIZE);
+    free(a); free(b);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,384 @@
+// sm3sum: SM3 checksums of files, in the output format of sha256sum.
+//
+//   gcc -O2 sm3sum.c -o sm3sum -lpthread
+//   ./sm3sum [-v] [-m | -t] FILE...     ("-" or no FILE reads stdin)
+//
+// Regular files are mmap'd with MADV_SEQUENTIAL and hashed in windows, with
+// MADV_WILLNEED issued one window ahead so the kernel reads while we compress.
+// Pipes, sockets and terminals go through a reader thread filling two buffers
+// alternately, so read() of one buffer overlaps hashing of the other.
+// -m hashes small regular files together through the multi-lane engine
+// (sm3_mb.h) instead of one stream at a time.
+// -v reports MB/s and how wall time splits between CPU (hashing) and I/O.
+// -t prints SM3-TREE digests (sm3_tree.h) instead of SM3: chunks are hashed in
+// parallel on all cores. They differ from SM3 and are tagged as such.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sm3.h"
+#include "sm3_mb.h"
+#include "sm3_tree.h"
+
+#define MAP_WINDOW (8u << 20)        // bytes hashed per madvise window
+#define PIPE_BUF_SIZE (1u << 20)     // each of the two reader buffers
+#define MB_FILE_MAX (1u << 20)       // -m: files up to this size go multi-lane
+#define MB_BATCH_FILES 4096
+#define MB_BATCH_BYTES (256u << 20)
+
+static int tree_mode;   // -t
+
+typedef struct {
+    uint64_t bytes;
+    double wall;    // seconds
+    double cpu;     // CPU time of the hashing thread
+} HASH_STATS;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// CPU time of the calling thread; wall time not spent here is I/O wait.
+static double thread_cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ------------------ regular files: mmap ------------------
+static int hash_mapped(int fd, size_t size, uint8_t out[SM3_DIGEST_SIZE]) {
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    if (tree_mode) {
+        // chunks are consumed by all threads at once: ask for the whole file
+        madvise(map, size, MADV_WILLNEED);
+        int rc = sm3_tree_hash(map, size, 0, out);
+        munmap(map, size);
+        if (rc != 0) errno = ENOMEM;
+        return rc;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    SM3_CTX ctx;
+    sm3_init(&ctx);
+    for (size_t off = 0; off < size; off += MAP_WINDOW) {
+        size_t n = (size - off < MAP_WINDOW) ? (size - off) : MAP_WINDOW;
+        if (off + n < size) {
+            size_t ahead = (size - off - n < MAP_WINDOW) ? (size - off - n) : MAP_WINDOW;
+            madvise(map + off + n, ahead, MADV_WILLNEED);
+        }
+        sm3_update(&ctx, map + off, n);
+    }
+    sm3_final(&ctx, out);
+    munmap(map, size);
+    return 0;
+}
+
+// ------------------ pipes / sockets: double-buffered reader ------------------
+typedef struct {
+    int fd;
+    uint8_t *buf[2];
+    size_t len[2];
+    int full[2];
+    int err;                // errno from read(), 0 if none
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+} PIPE_READER;
+
+// Fills buf[0], buf[1], buf[0], ... ; a zero-length buffer marks EOF/error.
+static void *reader_main(void *arg) {
+    PIPE_READER *r = arg;
+    for (int idx = 0; ; idx ^= 1) {
+        pthread_mutex_lock(&r->mu);
+        while (r->full[idx]) pthread_cond_wait(&r->cv, &r->mu);
+        pthread_mutex_unlock(&r->mu);
+
+        size_t got = 0;
+        int err = 0;
+        while (got < PIPE_BUF_SIZE) {
+            ssize_t n = read(r->fd, r->buf[idx] + got, PIPE_BUF_SIZE - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) { err = errno; break; }
+            if (n == 0) break;
+            got += (size_t)n;
+        }
+
+        pthread_mutex_lock(&r->mu);
+        r->len[idx] = err ? 0 : got;
+        r->err = err;
+        r->full[idx] = 1;
+        pthread_cond_signal(&r->cv);
+        pthread_mutex_unlock(&r->mu);
+        if (err || got == 0) return NULL;
+    }
+}
+
+static int hash_stream(int fd, uint8_t out[SM3_DIGEST_SIZE], uint64_t *bytes) {
+    PIPE_READER r;
+    memset(&r, 0, sizeof(r));
+    r.fd = fd;
+    r.buf[0] = malloc(PIPE_BUF_SIZE);
+    r.buf[1] = malloc(PIPE_BUF_SIZE);
+    if (!r.buf[0] || !r.buf[1]) {
+        free(r.buf[0]); free(r.buf[1]);
+        errno = ENOMEM;
+        return -1;
+    }
+    pthread_mutex_init(&r.mu, NULL);
+    pthread_cond_init(&r.cv, NULL);
+
+    pthread_t th;
+    int rc = pthread_create(&th, NULL, reader_main, &r);
+    if (rc != 0) {
+        free(r.buf[0]); free(r.buf[1]);
+        errno = rc;
+        return -1;
+    }
+
+    SM3_CTX ctx;
+    sm3_init(&ctx);
+    *bytes = 0;
+    for (int idx = 0; ; idx ^= 1) {
+        pthread_mutex_lock(&r.mu);
+        while (!r.full[idx]) pthread_cond_wait(&r.cv, &r.mu);
+        size_t n = r.len[idx];
+        pthread_mutex_unlock(&r.mu);
+        if (n == 0) break;
+
+        sm3_update(&ctx, r.buf[idx], n);
+        *bytes += n;
+
+        pthread_mutex_lock(&r.mu);
+        r.full[idx] = 0;
+        pthread_cond_signal(&r.cv);
+        pthread_mutex_unlock(&r.mu);
+    }
+    pthread_join(th, NULL);
+    sm3_final(&ctx, out);
+
+    pthread_mutex_destroy(&r.mu);
+    pthread_cond_destroy(&r.cv);
+    free(r.buf[0]); free(r.buf[1]);
+    if (r.err) { errno = r.err; return -1; }
+    return 0;
+}
+
+// -t on a pipe: the tree needs random access to all chunks, so read it all.
+static int hash_stream_tree(int fd, uint8_t out[SM3_DIGEST_SIZE], uint64_t *bytes) {
+    size_t cap = PIPE_BUF_SIZE, len = 0;
+    uint8_t *buf = malloc(cap);
+    if (!buf) { errno = ENOMEM; return -1; }
+    for (;;) {
+        if (len == cap) {
+            uint8_t *nb = realloc(buf, cap * 2);
+            if (!nb) { free(buf); errno = ENOMEM; return -1; }
+            buf = nb; cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { int e = errno; free(buf); errno = e; return -1; }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+    int rc = sm3_tree_hash(buf, len, 0, out);
+    free(buf);
+    *bytes = len;
+    if (rc != 0) errno = ENOMEM;
+    return rc;
+}
+
+// Hash one path ("-" = stdin), choosing mmap or the reader thread.
+static int hash_path(const char *path, uint8_t out[SM3_DIGEST_SIZE], HASH_STATS *st) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    double w0 = now_sec(), c0 = thread_cpu_sec();
+    struct stat sb;
+    int rc;
+    // procfs/sysfs files report st_size 0 but have content: read those too
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+        rc = hash_mapped(fd, (size_t)sb.st_size, out);
+        st->bytes = (uint64_t)sb.st_size;
+        // mmap of an unusual regular file (e.g. procfs) can fail; read it instead
+        if (rc != 0 && (errno == ENODEV || errno == EACCES || errno == EINVAL)) {
+            rc = tree_mode ? hash_stream_tree(fd, out, &st->bytes) : hash_stream(fd, out, &st->bytes);
+        }
+    } else {
+        rc = tree_mode ? hash_stream_tree(fd, out, &st->bytes) : hash_stream(fd, out, &st->bytes);
+    }
+    st->wall = now_sec() - w0;
+    st->cpu = thread_cpu_sec() - c0;
+
+    if (fd != STDIN_FILENO) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+    }
+    return rc;
+}
+
+// ------------------ -m: many small files through the multi-lane engine ------------------
+typedef struct {
+    const char *path;
+    int small;                     // small non-empty regular file at stat() time
+    uint8_t *map;
+    size_t size;
+    int err;                       // errno, 0 if ok
+    int done;                      // digest already computed
+    uint8_t digest[SM3_DIGEST_SIZE];
+} FILE_JOB;
+
+// Map a small file for the batch. The descriptor is closed right away (the
+// mapping stays valid), so a batch never holds more than one fd open.
+// Returns 0 if mapped; otherwise the job is left to hash_path, unless the
+// file could not be opened at all.
+static int map_small(FILE_JOB *j) {
+    int fd = open(j->path, O_RDONLY);
+    if (fd < 0) {
+        if (errno != EMFILE && errno != ENFILE) j->err = errno;
+        return -1;
+    }
+    struct stat sb;
+    int rc = -1;
+    // recheck: the file may have changed since main() looked at it
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 && (size_t)sb.st_size <= MB_FILE_MAX) {
+        j->size = (size_t)sb.st_size;
+        j->map = mmap(NULL, j->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (j->map == MAP_FAILED) j->map = NULL;
+        else rc = 0;
+    }
+    close(fd);
+    return rc;
+}
+
+static void hash_batch_mb(FILE_JOB *jobs, size_t n, HASH_STATS *st) {
+    SM3_MB_MGR mgr;
+    sm3_mb_init(&mgr);
+    const uint8_t **msgs = malloc(n * sizeof(*msgs));
+    size_t *lens = malloc(n * sizeof(*lens));
+    uint8_t (*digests)[SM3_DIGEST_SIZE] = malloc(n * SM3_DIGEST_SIZE);
+    size_t *which = malloc(n * sizeof(*which));
+
+    double w0 = now_sec(), c0 = thread_cpu_sec();
+    size_t i = 0;
+    while (i < n) {
+        // map one batch, bounded by file count and mapped bytes
+        size_t m = 0, mapped = 0;
+        for (; i < n && m < MB_BATCH_FILES && mapped < MB_BATCH_BYTES; ++i) {
+            FILE_JOB *j = &jobs[i];
+            if (j->done || j->err || !j->small) continue;
+            if (map_small(j) != 0) continue;
+            msgs[m] = j->map; lens[m] = j->size; which[m] = i;
+            mapped += j->size;
+            m++;
+        }
+        sm3_mb_hash_many(&mgr, msgs, lens, m, digests);
+        for (size_t k = 0; k < m; ++k) {
+            FILE_JOB *j = &jobs[which[k]];
+            memcpy(j->digest, digests[k], SM3_DIGEST_SIZE);
+            munmap(j->map, j->size);
+            j->map = NULL;
+            j->done = 1;
+            st->bytes += j->size;
+        }
+    }
+    st->wall += now_sec() - w0;
+    st->cpu += thread_cpu_sec() - c0;
+
+    free(msgs); free(lens); free(digests); free(which);
+}
+
+// ------------------ main ------------------
+static void print_digest(const uint8_t d[SM3_DIGEST_SIZE], const char *path) {
+    if (tree_mode) printf("SM3-TREE (%s) = ", path);
+    for (int i = 0; i < SM3_DIGEST_SIZE; ++i) printf("%02x", d[i]);
+    if (tree_mode) printf("\n");
+    else printf("  %s\n", path);
+}
+
+static void print_stats(const char *what, const HASH_STATS *st) {
+    double mb = st->bytes / (1024.0 * 1024.0);
+    double wall = st->wall > 0 ? st->wall : 1e-9;
+    double cpu = st->cpu < wall ? st->cpu : wall;
+    fprintf(stderr, "sm3sum: %s: %.1f MB in %.3f s, %.1f MB/s, cpu %.0f%% / io %.0f%%\n",
+            what, mb, wall, mb / wall, 100.0 * cpu / wall, 100.0 * (wall - cpu) / wall);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: sm3sum [-v] [-m | -t] [FILE...]\n"
+                    "  -v  report throughput and CPU/I-O split on stderr\n"
+                    "  -m  hash small regular files in parallel lanes\n"
+                    "  -t  SM3-TREE digests (parallel, not plain SM3)\n");
+}
+
+int main(int argc, char **argv) {
+    int verbose = 0, multi = 0, status = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "vmth")) != -1) {
+        switch (opt) {
+        case 'v': verbose = 1; break;
+        case 'm': multi = 1; break;
+        case 't': tree_mode = 1; break;
+        default: usage(); return 2;
+        }
+    }
+    static char *stdin_only[] = { "-" };
+    char **paths = (optind < argc) ? argv + optind : stdin_only;
+    size_t n = (optind < argc) ? (size_t)(argc - optind) : 1;
+
+    FILE_JOB *jobs = calloc(n, sizeof(*jobs));
+    HASH_STATS total = {0, 0, 0};
+    for (size_t i = 0; i < n; ++i) {
+        jobs[i].path = paths[i];
+    }
+
+    if (multi && !tree_mode) {
+        // files are opened batch by batch in hash_batch_mb; empty ones
+        // (possibly procfs/sysfs) and anything else go through hash_path
+        for (size_t i = 0; i < n; ++i) {
+            struct stat sb;
+            if (strcmp(paths[i], "-") == 0) continue;
+            if (stat(paths[i], &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 &&
+                (size_t)sb.st_size <= MB_FILE_MAX) jobs[i].small = 1;
+        }
+        HASH_STATS st = {0, 0, 0};
+        hash_batch_mb(jobs, n, &st);
+        if (verbose) print_stats("multi-lane batch", &st);
+        total.bytes += st.bytes; total.wall += st.wall; total.cpu += st.cpu;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        FILE_JOB *j = &jobs[i];
+        if (!j->done && !j->err) {
+            HASH_STATS st = {0, 0, 0};
+            if (hash_path(j->path, j->digest, &st) == 0) {
+                j->done = 1;
+                if (verbose) print_stats(j->path, &st);
+                total.bytes += st.bytes; total.wall += st.wall; total.cpu += st.cpu;
+            } else {
+                j->err = errno;
+            }
+        }
+        if (j->err) {
+            fprintf(stderr, "sm3sum: %s: %s\n", j->path, strerror(j->err));
+            status = 1;
+        } else {
+            print_digest(j->digest, j->path);
+        }
+    }
+    if (verbose && n > 1) print_stats("total", &total);
+
+    free(jobs);
+    return status;
+}
@@ -0,0 +1,109 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Minimal work-stealing parallel-for on pthreads (link with -lpthread).
+//
+// [0, n) is split into one contiguous range per worker. A worker claims
+// `grain`-sized pieces of its own range with an atomic fetch-add; once its
+// range is exhausted it steals pieces from the other workers' ranges the same
+// way. Uneven tasks therefore balance without a central queue, and every index
+// is processed exactly once, so results written by index are deterministic
+// regardless of the thread count. The calling thread is worker 0.
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define POOL_MAX_THREADS 256
+
+typedef void (*pool_task_fn)(void *arg, size_t begin, size_t end);
+
+typedef struct {
+    _Atomic size_t next;
+    size_t end;
+    char pad[64 - sizeof(size_t) * 2];   // one range per cache line
+} POOL_RANGE;
+
+typedef struct {
+    POOL_RANGE ranges[POOL_MAX_THREADS];
+    int nthreads;
+    size_t grain;
+    pool_task_fn fn;
+    void *arg;
+} POOL_JOB;
+
+typedef struct {
+    POOL_JOB *job;
+    int id;
+} POOL_WORKER;
+
+// >0 while the current thread is running pool tasks: nested parallel_for
+// calls then run inline instead of spawning threads of their own.
+static __thread int pool_nesting;
+
+static inline int pool_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > POOL_MAX_THREADS) n = POOL_MAX_THREADS;
+    return (int)n;
+}
+
+static inline void *pool_worker_main(void *p) {
+    POOL_WORKER *w = p;
+    POOL_JOB *job = w->job;
+    pool_nesting++;
+    // own range first, then steal round-robin from the others
+    for (int k = 0; k < job->nthreads; ++k) {
+        POOL_RANGE *r = &job->ranges[(w->id + k) % job->nthreads];
+        for (;;) {
+            size_t b = atomic_fetch_add_explicit(&r->next, job->grain, memory_order_relaxed);
+            if (b >= r->end) break;
+            size_t e = (r->end - b < job->grain) ? r->end : b + job->grain;
+            job->fn(job->arg, b, e);
+        }
+    }
+    pool_nesting--;
+    return NULL;
+}
+
+// Run fn(arg, begin, end) over [0, n) on nthreads threads (<= 0: one per CPU).
+static inline void pool_parallel_for(size_t n, size_t grain, int nthreads,
+                                     pool_task_fn fn, void *arg) {
+    if (n == 0) return;
+    if (grain == 0) grain = 1;
+    if (nthreads <= 0) nthreads = pool_default_threads();
+    if (nthreads > POOL_MAX_THREADS) nthreads = POOL_MAX_THREADS;
+    if ((size_t)nthreads > (n + grain - 1) / grain) nthreads = (int)((n + grain - 1) / grain);
+    if (nthreads == 1 || pool_nesting > 0) {
+        for (size_t b = 0; b < n; b += grain) fn(arg, b, (n - b < grain) ? n : b + grain);
+        return;
+    }
+
+    POOL_JOB job;
+    POOL_WORKER workers[POOL_MAX_THREADS];
+    pthread_t threads[POOL_MAX_THREADS];
+    job.nthreads = nthreads;
+    job.grain = grain;
+    job.fn = fn;
+    job.arg = arg;
+    for (int t = 0; t < nthreads; ++t) {
+        atomic_init(&job.ranges[t].next, n * (size_t)t / (size_t)nthreads);
+        job.ranges[t].end = n * (size_t)(t + 1) / (size_t)nthreads;
+    }
+
+    int started = 1;
+    for (int t = 1; t < nthreads; ++t) {
+        workers[t].job = &job;
+        workers[t].id = t;
+        if (pthread_create(&threads[t], NULL, pool_worker_main, &workers[t]) != 0) break;
+        started++;
+    }
+    // worker 0 (this thread) also steals from ranges whose thread failed to start
+    workers[0].job = &job;
+    workers[0].id = 0;
+    pool_worker_main(&workers[0]);
+    for (int t = 1; t < started; ++t) pthread_join(threads[t], NULL);
+}
+
+#endif